@@ -0,0 +1,131 @@
+/*!
+ * \file
+ * \brief Pool of recycled point cloud buffers.
+ */
+
+#ifndef CLOUDPOOL_HPP_
+#define CLOUDPOOL_HPP_
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <pcl/point_cloud.h>
+
+namespace Processors {
+namespace DepthConverter {
+
+/*!
+ * \class CloudPool
+ * \brief Recycles point cloud buffers between frames.
+ *
+ * Clouds are handed out as regular shared pointers. When the last copy held
+ * by downstream components is released, the cloud (together with its point
+ * storage) returns to the pool instead of being freed, so that steady-state
+ * processing does not allocate. At most max_depth idle clouds are kept.
+ * The pool state is shared with the handed out clouds, so they may safely
+ * outlive the pool itself.
+ */
+template <typename PointT>
+class CloudPool {
+public:
+	typedef pcl::PointCloud<PointT> Cloud;
+	typedef typename Cloud::Ptr CloudPtr;
+
+	explicit CloudPool(size_t max_depth = 4) :
+		state(new State(max_depth)) {
+	}
+
+	/*!
+	 * Returns a cloud of width x height points, reusing an idle buffer if possible.
+	 * Contents of the points are unspecified.
+	 */
+	CloudPtr acquire(uint32_t width, uint32_t height) {
+		Cloud * cloud = NULL;
+		{
+			boost::mutex::scoped_lock lock(state->mutex);
+			if (!state->idle.empty()) {
+				cloud = state->idle.back();
+				state->idle.pop_back();
+			}
+			++state->in_use;
+			if (state->in_use + state->idle.size() > state->high_water)
+				state->high_water = state->in_use + state->idle.size();
+		}
+
+		if (!cloud)
+			cloud = new Cloud;
+
+		cloud->header = pcl::PCLHeader();
+		cloud->points.resize(width * height);
+		cloud->width = width;
+		cloud->height = height;
+		return CloudPtr(cloud, Releaser(state));
+	}
+
+	/// Sets maximal number of idle clouds kept in the pool.
+	void setMaxDepth(size_t max_depth) {
+		boost::mutex::scoped_lock lock(state->mutex);
+		state->max_depth = max_depth;
+		while (state->idle.size() > max_depth) {
+			delete state->idle.back();
+			state->idle.pop_back();
+		}
+	}
+
+	/// Number of idle clouds waiting in the pool.
+	size_t depth() const {
+		boost::mutex::scoped_lock lock(state->mutex);
+		return state->idle.size();
+	}
+
+	/// Maximal number of clouds alive (in use and idle) at the same time.
+	size_t highWaterMark() const {
+		boost::mutex::scoped_lock lock(state->mutex);
+		return state->high_water;
+	}
+
+private:
+	struct State {
+		explicit State(size_t max_depth_) :
+			max_depth(max_depth_), in_use(0), high_water(0) {
+		}
+
+		~State() {
+			for (size_t i = 0; i < idle.size(); ++i)
+				delete idle[i];
+		}
+
+		boost::mutex mutex;
+		std::vector<Cloud *> idle;
+		size_t max_depth;
+		size_t in_use;
+		size_t high_water;
+	};
+
+	/// Deleter returning released clouds to the pool.
+	struct Releaser {
+		explicit Releaser(const boost::shared_ptr<State> & state_) :
+			state(state_) {
+		}
+
+		void operator()(Cloud * cloud) {
+			boost::mutex::scoped_lock lock(state->mutex);
+			--state->in_use;
+			if (state->idle.size() < state->max_depth)
+				state->idle.push_back(cloud);
+			else
+				delete cloud;
+		}
+
+		boost::shared_ptr<State> state;
+	};
+
+	boost::shared_ptr<State> state;
+};
+
+} //: namespace DepthConverter
+} //: namespace Processors
+
+#endif /* CLOUDPOOL_HPP_ */
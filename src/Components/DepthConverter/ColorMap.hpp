@@ -0,0 +1,85 @@
+/*!
+ * \file
+ * \brief Mapping of sampled depth pixels onto pixels of the colour image.
+ */
+
+#ifndef COLORMAP_HPP_
+#define COLORMAP_HPP_
+
+#include <vector>
+
+#include "PixelGrid.hpp"
+
+namespace Processors {
+namespace DepthConverter {
+
+/*!
+ * \class ColorMap
+ * \brief Colour pixel of every cell of the sampling grid.
+ *
+ * Colour image is assumed to be registered with the depth image, but it
+ * may have a different resolution - cells are then mapped onto the nearest
+ * colour pixel (by pixel centres). Maps are rebuilt only when the grid or
+ * colour image size changes. If both images have the same size and every
+ * pixel is sampled, no column map is needed at all.
+ */
+class ColorMap {
+public:
+	ColorMap() : color_cols(0), color_rows(0), contiguous(false) {
+	}
+
+	/*!
+	 * Rebuilds maps for the given grid and colour image size, if necessary.
+	 * \returns true if maps were rebuilt
+	 */
+	bool update(const PixelGrid & grid_, int color_cols_, int color_rows_) {
+		if (grid_ == grid && color_cols_ == color_cols && color_rows_ == color_rows)
+			return false;
+
+		grid = grid_;
+		color_cols = color_cols_;
+		color_rows = color_rows_;
+		contiguous = grid.stride == 1 && color_cols == grid.image_cols && color_rows == grid.image_rows;
+
+		col_map.resize(grid.cols);
+		for (int i = 0; i < grid.cols; ++i)
+			col_map[i] = scale(grid.u(i), grid.image_cols, color_cols);
+
+		row_map.resize(grid.rows);
+		for (int j = 0; j < grid.rows; ++j)
+			row_map[j] = scale(grid.v(j), grid.image_rows, color_rows);
+
+		return true;
+	}
+
+	/// Colour image row of the grid row j.
+	int row(int j) const { return row_map[j]; }
+
+	/// Colour image columns of grid columns, or NULL if grid columns map to consecutive pixels.
+	const int * cols() const { return contiguous ? NULL : &col_map[0]; }
+
+	/// Colour image column of the grid column i.
+	int col(int i) const { return col_map[i]; }
+
+private:
+	/// Nearest pixel of the destination image (with n_dst pixels) to pixel p of the source one.
+	static int scale(int p, int n_src, int n_dst) {
+		if (n_src == n_dst)
+			return p;
+		int q = (int) (((2LL * p + 1) * n_dst) / (2LL * n_src));
+		return q < n_dst ? q : n_dst - 1;
+	}
+
+	PixelGrid grid;
+	int color_cols;
+	int color_rows;
+	bool contiguous;
+
+	std::vector<int> col_map;
+	std::vector<int> row_map;
+};
+
+} //: namespace DepthConverter
+} //: namespace Processors
+
+#endif /* COLORMAP_HPP_ */
@@ -4,10 +4,13 @@
  * \author Maciej Stefańczyk [maciek.slon@gmail.com]
  */
 
+#include <algorithm>
 #include <memory>
+#include <numeric>
 #include <string>
 
 #include "DepthConverter.hpp"
+#include "RowSources.hpp"
 #include "Common/Logger.hpp"
 
 #include <boost/bind.hpp>
@@ -16,13 +19,44 @@
 
 #include <pcl/filters/filter.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 namespace Processors {
 namespace DepthConverter {
 
 DepthConverter::DepthConverter(const std::string & name) :
 		Base::Component(name),
-		prop_remove_nan("remove_nan", true)  {
+		prop_remove_nan("remove_nan", true),
+		prop_simd("simd", true),
+		prop_threads("threads", 1),
+		prop_indices("indices", false),
+		prop_sparse_mask("sparse_mask", false),
+		prop_roi_x("roi.x", 0),
+		prop_roi_y("roi.y", 0),
+		prop_roi_width("roi.width", 0),
+		prop_roi_height("roi.height", 0),
+		prop_stride("stride", 1),
+		prop_undistort("undistort", false),
+		prop_pool_size("pool.size", 4),
+		prop_pool_depth("pool.depth", 0),
+		prop_pool_high_water("pool.high_water", 0),
+		backproject_kernel(backprojectRowScalar)  {
 			registerProperty(prop_remove_nan);
+			registerProperty(prop_simd);
+			registerProperty(prop_threads);
+			registerProperty(prop_indices);
+			registerProperty(prop_sparse_mask);
+			registerProperty(prop_roi_x);
+			registerProperty(prop_roi_y);
+			registerProperty(prop_roi_width);
+			registerProperty(prop_roi_height);
+			registerProperty(prop_stride);
+			registerProperty(prop_undistort);
+			registerProperty(prop_pool_size);
+			registerProperty(prop_pool_depth);
+			registerProperty(prop_pool_high_water);
 }
 
 DepthConverter::~DepthConverter() {
@@ -37,6 +71,7 @@ void DepthConverter::prepareInterface() {
 	registerStream("in_camera_info", &in_camera_info);
 	registerStream("out_cloud_xyz", &out_cloud_xyz);
 	registerStream("out_cloud_xyzrgb", &out_cloud_xyzrgb);
+	registerStream("out_indices", &out_indices);
 
 	// Register handlers - depth dependent functions (CAMERA INFO required).
 	registerHandler("process_depth", boost::bind(&DepthConverter::process_depth, this));
@@ -80,6 +115,10 @@ void DepthConverter::prepareInterface() {
 
 bool DepthConverter::onInit() {
 	CLOG(LTRACE) << "DepthConverter::onInit";
+
+	const char * kernel_name;
+	backproject_kernel = selectBackprojectKernel(&kernel_name);
+	CLOG(LINFO) << "Using " << kernel_name << " back-projection kernel";
 	return true;
 }
 
@@ -95,175 +134,174 @@ bool DepthConverter::onStart() {
 	return true;
 }
 
-void DepthConverter::process_depth() {
-	CLOG(LTRACE) << "DepthConverter::process_depth\n";
-	
-	Types::CameraInfo camera_info = in_camera_info.read();
-	cv::Mat depth = in_depth.read();
+int DepthConverter::threadCount() const {
+#ifdef _OPENMP
+	// Non-positive values let OpenMP decide (usually one thread per core).
+	return prop_threads > 0 ? (int) prop_threads : omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
 
-	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZ>(camera_info.width(), camera_info.height()));
+PixelGrid DepthConverter::samplingGrid(int cols, int rows) const {
+	return PixelGrid::make(cols, rows, prop_roi_x, prop_roi_y, prop_roi_width, prop_roi_height, prop_stride);
+}
 
-	double fx_d = 0.001 / camera_info.fx();
-	double fy_d = 0.001 / camera_info.fy();
-	double cx_d = camera_info.cx();
-	double cy_d = camera_info.cy();
+void DepthConverter::updateRays(const Types::CameraInfo & camera_info, const PixelGrid & grid) {
+	if (rays.update(camera_info, grid, prop_undistort))
+		CLOG(LDEBUG) << "Ray table rebuilt for " << grid.cols << "x" << grid.rows << " samples of "
+				<< camera_info.width() << "x" << camera_info.height() << " image";
+}
 
-	float bad_point = std::numeric_limits<float>::quiet_NaN();
+const ColorMap & DepthConverter::colorMap(const cv::Mat & color, const PixelGrid & grid) {
+	if (color_map.update(grid, color.cols, color.rows))
+		CLOG(LDEBUG) << "Colour map rebuilt for " << color.cols << "x" << color.rows << " colour image";
+	return color_map;
+}
 
-	pcl::PointCloud<pcl::PointXYZ>::iterator pt_iter = cloud->begin();
-	const uint16_t* depth_row = reinterpret_cast<const uint16_t*>(&depth.data[0]);
+template <typename PointT, typename Rows>
+typename pcl::PointCloud<PointT>::Ptr DepthConverter::assemble(const Rows & rows, const PixelGrid & grid, const MaskRuns * runs) {
+	typename pcl::PointCloud<PointT>::Ptr cloud;
+	const int width = grid.cols;
+	const int height = grid.rows;
+	const int threads = threadCount();
 
-	int row_step = depth.step1();
-	for (int v = 0; v < (int) cloud->height; ++v, depth_row += row_step) {
-		for (int u = 0; u < (int) cloud->width; ++u) {
-			pcl::PointXYZ& pt = *pt_iter++;
-			uint16_t depth = depth_row[u];
+	CloudPool<PointT> & pool = cloudPool(static_cast<const PointT *>(NULL));
+	pool.setMaxDepth(std::max(0, (int) prop_pool_size));
 
-			// Missing points denoted by NaNs
-			if (depth == 0) {
-				pt.x = pt.y = pt.z = bad_point;
-				continue;
-			}
+	if (!prop_remove_nan) {
+		// Organized cloud - rows are written in place, missing points denoted by NaNs.
+		cloud = pool.acquire(width, height);
+		cloud->is_dense = false;
 
-			// Fill in XYZ
-			pt.x = (u - cx_d) * depth * fx_d;
-			pt.y = (v - cy_d) * depth * fy_d;
-			pt.z = depth * 0.001;
-		}
-	}
+		#pragma omp parallel for num_threads(threads) schedule(static)
+		for (int j = 0; j < height; ++j)
+			rows.fill(j, 0, width, &cloud->points[j * width]);
 
-	if(prop_remove_nan){
-		std::vector<int> indices;
-		cloud->is_dense = false; 
-		pcl::removeNaNFromPointCloud(*cloud, *cloud, indices);
+		updatePoolStats(pool);
+		return cloud;
 	}
-	
-	out_cloud_xyz.write(cloud);
-/*	pcl::io::savePCDFileASCII ("test_pcd.pcd", *cloud);
-	CCLOG(LNOTICE) << "Saved " << cloud->points.size () << " data points to test_pcd.pcd.";*/
-}
-
-void DepthConverter::process_depth_mask() {
-	CLOG(LTRACE) << "DepthConverter::process_depth_mask\n";
-	
-	Types::CameraInfo camera_info = in_camera_info.read();
-	cv::Mat depth = in_depth.read();
-	cv::Mat mask = in_mask.read();
-	mask.convertTo(mask, CV_32F);
-	
-	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZ>(camera_info.width(), camera_info.height()));
 
-//	cloud.width = camera_info.width();
-//	cloud.height = camera_info.height();
-//	cloud.points.resize(cloud.width * cloud.height);
+	// Without runs every row is processed as a single span.
+	std::vector<Span> full_row(1, Span(0, width));
 
-	double fx_d = 0.001 / camera_info.fx();
-	double fy_d = 0.001 / camera_info.fy();
-	double cx_d = camera_info.cx();
-	double cy_d = camera_info.cy();
+	// Count valid points in every row, so that every row knows where its points start.
+	std::vector<int> offsets(height + 1, 0);
 
-	float bad_point = std::numeric_limits<float>::quiet_NaN();
+	#pragma omp parallel for num_threads(threads) schedule(static)
+	for (int j = 0; j < height; ++j) {
+		const std::vector<Span> & spans = runs ? runs->row(j) : full_row;
+		int count = 0;
+		for (size_t s = 0; s < spans.size(); ++s)
+			for (int i = spans[s].begin; i < spans[s].end; ++i)
+				count += rows.valid(j, i);
+		offsets[j + 1] = count;
+	}
+	std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
 
-	pcl::PointCloud<pcl::PointXYZ>::iterator pt_iter = cloud->begin();
-	const uint16_t* depth_row = reinterpret_cast<const uint16_t*>(&depth.data[0]);
+	const int size = offsets[height];
+	cloud = pool.acquire(size, 1);
+	cloud->is_dense = true;
 
-	int row_step = depth.step1();
-	for (int v = 0; v < (int) cloud->height; ++v, depth_row += row_step) {
-		for (int u = 0; u < (int) cloud->width; ++u) {
-			pcl::PointXYZ& pt = *pt_iter++;
-			uint16_t depth = depth_row[u];
+	pcl::PointIndices::Ptr indices;
+	if (prop_indices) {
+		indices.reset(new pcl::PointIndices);
+		indices->indices.resize(size);
+	}
 
-			// Missing points denoted by NaNs
-			if (depth == 0 || mask.at<float>(v, u)==0) {
-				pt.x = pt.y = pt.z = bad_point;
-				continue;
+	// Convert spans and copy only valid points to their final positions.
+	#pragma omp parallel num_threads(threads)
+	{
+		std::vector<PointT, Eigen::aligned_allocator<PointT> > row(width);
+
+		#pragma omp for schedule(static)
+		for (int j = 0; j < height; ++j) {
+			const std::vector<Span> & spans = runs ? runs->row(j) : full_row;
+			int k = offsets[j];
+			for (size_t s = 0; s < spans.size(); ++s) {
+				const int begin = spans[s].begin;
+				rows.fill(j, begin, spans[s].end, &row[0]);
+
+				for (int i = begin; i < spans[s].end; ++i) {
+					if (!rows.valid(j, i))
+						continue;
+					cloud->points[k] = row[i - begin];
+					if (indices)
+						indices->indices[k] = grid.pixel(i, j);
+					++k;
+				}
 			}
-
-			// Fill in XYZ
-			pt.x = (u - cx_d) * depth * fx_d;
-			pt.y = (v - cy_d) * depth * fy_d;
-			pt.z = depth * 0.001;
 		}
 	}
 
-	if(prop_remove_nan){
-		std::vector<int> indices;
-		cloud->is_dense = false; 
-		pcl::removeNaNFromPointCloud(*cloud, *cloud, indices);
-	}
+	if (indices)
+		out_indices.write(indices);
 
-	out_cloud_xyz.write(cloud);
-	/*pcl::io::savePCDFileASCII ("test_pcd.pcd", *cloud);
-	CCLOG(LNOTICE) << "Saved " << cloud->points.size () << " data points to test_pcd.pcd.";*/
+	updatePoolStats(pool);
+	return cloud;
 }
 
-void DepthConverter::process_depth_mask_color() {
-	CLOG(LTRACE) << "DepthConverter::process_depth_mask_color\n";
-	
-	Types::CameraInfo camera_info = in_camera_info.read();
-	cv::Mat depth = in_depth.read();
-	cv::Mat mask = in_mask.read();
-	mask.convertTo(mask, CV_32F);
-	cv::Mat color = in_color.read();
-	//color.convertTo(color, CV_8UC3);
-
-	
-	
-	//for(int i=0; i < features.features.size(); i++){
-		////cout<<features.features[i].pt<<endl;
-	//}
-	
-	
-	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>(camera_info.width(), camera_info.height()));
-
-	double fx_d = 0.001 / camera_info.fx();
-	double fy_d = 0.001 / camera_info.fy();
-	double cx_d = camera_info.cx();
-	double cy_d = camera_info.cy();
-
-	float bad_point = std::numeric_limits<float>::quiet_NaN();
+const MaskRuns * DepthConverter::maskRuns(const cv::Mat & mask, const PixelGrid & grid) {
+	// Sparse iteration makes sense only when the result is compacted.
+	if (!prop_sparse_mask || !prop_remove_nan)
+		return NULL;
 
-	pcl::PointCloud<pcl::PointXYZRGB>::iterator pt_iter = cloud->begin();
-	const uint16_t* depth_row = reinterpret_cast<const uint16_t*>(&depth.data[0]);
+	mask_runs.build(mask, grid, threadCount());
+	CLOG(LDEBUG) << "Mask covers " << mask_runs.count() << " pixels";
+	return &mask_runs;
+}
 
-	int row_step = depth.step1();
-	for (int v = 0; v < (int) cloud->height; ++v, depth_row += row_step) {
-		for (int u = 0; u < (int) cloud->width; ++u) {
-			//pcl::PointXYZ& pt = *pt_iter++;
-			pcl::PointXYZRGB& pt = *pt_iter++;
-			uint16_t depth = depth_row[u];
+template <typename PointT>
+void DepthConverter::updatePoolStats(const CloudPool<PointT> & pool) {
+	prop_pool_depth = (int) pool.depth();
+	prop_pool_high_water = (int) pool.highWaterMark();
+	CLOG(LDEBUG) << "Cloud pool depth: " << prop_pool_depth << ", high-water mark: " << prop_pool_high_water;
+}
 
-			// Missing points denoted by NaNs
-			if (depth == 0 || mask.at<float>(v, u)==0) {
-				pt.x = pt.y = pt.z = bad_point;
-				continue;
-			}
+void DepthConverter::process_depth() {
+	CLOG(LTRACE) << "DepthConverter::process_depth\n";
+	
+	Types::CameraInfo camera_info = in_camera_info.read();
+	cv::Mat depth = in_depth.read();
+	PixelGrid grid = samplingGrid(camera_info.width(), camera_info.height());
+	updateRays(camera_info, grid);
 
-			// Fill in XYZ
-			pt.x = (u - cx_d) * depth * fx_d;
-			pt.y = (v - cy_d) * depth * fy_d;
-			pt.z = depth * 0.001;
-			
-			// Fill in RGB
-			cv::Vec3b bgr = color.at<cv::Vec3b>(v, u);
-			int b = bgr[0];
-			int g = bgr[1];
-			int r = bgr[2];
-			//cout<< b << " " << g << " " << r << endl;// << " " << bgr[1] << " " << bgr[2]<<endl;			
-			pt.r = r;
-			pt.g = g;
-			pt.b = b;
-		}
-	}
+	DepthRows<pcl::PointXYZ> rows(depth, grid, rays, backprojectKernel());
+	out_cloud_xyz.write(assemble<pcl::PointXYZ>(rows, grid));
+}
 
+void DepthConverter::process_depth_mask() {
+	CLOG(LTRACE) << "DepthConverter::process_depth_mask\n";
+	
+	Types::CameraInfo camera_info = in_camera_info.read();
+	cv::Mat depth = in_depth.read();
+	cv::Mat mask = in_mask.read();
+	mask = toByteMask(mask);
+	PixelGrid grid = samplingGrid(camera_info.width(), camera_info.height());
+	updateRays(camera_info, grid);
 
-	if(prop_remove_nan){
-		std::vector<int> indices;
-		cloud->is_dense = false; 
-		pcl::removeNaNFromPointCloud(*cloud, *cloud, indices);
-	}
+	DepthRows<pcl::PointXYZ> depth_rows(depth, grid, rays, backprojectKernel());
+	MaskedRows<DepthRows<pcl::PointXYZ>, pcl::PointXYZ> rows(depth_rows, mask, grid);
+	out_cloud_xyz.write(assemble<pcl::PointXYZ>(rows, grid, maskRuns(mask, grid)));
+}
 
-	out_cloud_xyzrgb.write(cloud);
+void DepthConverter::process_depth_mask_color() {
+	CLOG(LTRACE) << "DepthConverter::process_depth_mask_color\n";
+	
+	Types::CameraInfo camera_info = in_camera_info.read();
+	cv::Mat depth = in_depth.read();
+	cv::Mat mask = in_mask.read();
+	mask = toByteMask(mask);
+	cv::Mat color = in_color.read();
+	PixelGrid grid = samplingGrid(camera_info.width(), camera_info.height());
+	updateRays(camera_info, grid);
+
+	typedef DepthRows<pcl::PointXYZRGB> Depth;
+	typedef MaskedRows<Depth, pcl::PointXYZRGB> Masked;
+	Depth depth_rows(depth, grid, rays, backprojectKernel());
+	Masked masked_rows(depth_rows, mask, grid);
+	ColoredRows<Masked, pcl::PointXYZRGB> rows(masked_rows, color, colorMap(color, grid));
+	out_cloud_xyzrgb.write(assemble<pcl::PointXYZRGB>(rows, grid, maskRuns(mask, grid)));
 }
 
 void DepthConverter::process_depth_color() {
@@ -272,200 +310,47 @@ void DepthConverter::process_depth_color() {
 	cv::Mat depth = in_depth.read();
 	cv::Mat color = in_color.read();
 	CLOG(LDEBUG) << "Width"<< camera_info.width()<<" Height: "<<camera_info.height()<<endl;
-	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>(camera_info.width(), camera_info.height()));
-
-	double fx_d = 0.001 / camera_info.fx();
-	double fy_d = 0.001 / camera_info.fy();
-	double cx_d = camera_info.cx();
-	double cy_d = camera_info.cy();
-
-	float bad_point = std::numeric_limits<float>::quiet_NaN();
-
-	pcl::PointCloud<pcl::PointXYZRGB>::iterator pt_iter = cloud->begin();
-	const uint16_t* depth_row = reinterpret_cast<const uint16_t*>(&depth.data[0]);
-
-	int row_step = depth.step1();
-	for (int v = 0; v < (int) cloud->height; ++v, depth_row += row_step) {
-		for (int u = 0; u < (int) cloud->width; ++u) {
-			pcl::PointXYZRGB& pt = *pt_iter++;
-			uint16_t depth = depth_row[u];
-
-			// Missing points denoted by NaNs
-			if (depth == 0) {
-				pt.x = pt.y = pt.z = bad_point;
-				continue;
-			}
+	PixelGrid grid = samplingGrid(camera_info.width(), camera_info.height());
+	updateRays(camera_info, grid);
 
-			// Fill in XYZ
-			pt.x = (u - cx_d) * depth * fx_d;
-			pt.y = (v - cy_d) * depth * fy_d;
-			pt.z = depth * 0.001;
-			
-			// Fill in RGB
-			//pt.rgba = color.at<float>(v, u);
-			cv::Vec3b bgr = color.at<cv::Vec3b>(v, u);
-			int b = bgr[0];
-			int g = bgr[1];
-			int r = bgr[2];		
-			pt.r = r;
-			pt.g = g;
-			pt.b = b;
-		}
-	}
-
-	if(prop_remove_nan){
-		std::vector<int> indices;
-		cloud->is_dense = false; 
-		pcl::removeNaNFromPointCloud(*cloud, *cloud, indices);
-	}
-
-	out_cloud_xyzrgb.write(cloud);
-	
-	
+	typedef DepthRows<pcl::PointXYZRGB> Depth;
+	Depth depth_rows(depth, grid, rays, backprojectKernel());
+	ColoredRows<Depth, pcl::PointXYZRGB> rows(depth_rows, color, colorMap(color, grid));
+	out_cloud_xyzrgb.write(assemble<pcl::PointXYZRGB>(rows, grid));
 }
 
 void DepthConverter::process_depth_xyz() {
     CLOG(LTRACE) << "DepthConverter::process_depth_xyz"<<endl;
     cv::Mat depth_xyz = in_depth_xyz.read();
-    pcl::PointCloud<pcl::PointXYZ>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZ>(depth_xyz.cols,depth_xyz.rows));
-
-    const double max_z = 1.0e4;
-    CLOG(LINFO) << "Generating depth point cloud";
-    try {
-        for(int y = 0; y < depth_xyz.rows; y++)
-        {
-            for(int x = 0; x < depth_xyz.cols; x++)
-            {
-                cv::Vec3f point = depth_xyz.at<cv::Vec3f>(y, x);
-                if(fabs(point[2] - max_z) < FLT_EPSILON || fabs(point[2]) > max_z) continue;
-
-                //Insert info into point cloud structure
-                pcl::PointXYZ point1;
-                point1.x = point[0];
-                point1.y = point[1];
-                point1.z = point[2];
-                cloud->push_back(point1);
-            }
-        }
-    } catch (...)
-    {
-        CLOG(LERROR) << "Error occurred in processing input";
-    }
-
-
-//    pcl::PointCloud<pcl::PointXYZ>::iterator pt_iter = cloud->begin();
-//    for (int v = 0; v < (int) cloud->height; ++v) {
-//        for (int u = 0; u < (int) cloud->width; ++u) {
-//            pcl::PointXYZ& pt = *pt_iter++;
-//            // Fill in XYZ
-//            pt.x = depth_xyz[u][v][0];
-//            pt.y = depth_xyz[u][v][1];
-//            pt.z = depth_xyz[u][v][2];
-
-//        }
-//    }
-
-    if(prop_remove_nan){
-        std::vector<int> indices;
-        cloud->is_dense = false;
-        pcl::removeNaNFromPointCloud(*cloud, *cloud, indices);
-    }
-    out_cloud_xyz.write(cloud);
+    PixelGrid grid = samplingGrid(depth_xyz.cols, depth_xyz.rows);
+
+    XYZRows<pcl::PointXYZ> rows(depth_xyz, grid);
+    out_cloud_xyz.write(assemble<pcl::PointXYZ>(rows, grid));
 }
 
 void DepthConverter::process_depth_xyz_color() {
     CLOG(LTRACE) << "DepthConverter::process_depth_xyz_color()"<<endl;
     cv::Mat depth_xyz = in_depth_xyz.read();
+    PixelGrid grid = samplingGrid(depth_xyz.cols, depth_xyz.rows);
     cv::Mat color = in_color.read();
 
-    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGB>());
-    uint32_t pr, pg, pb;
-    const double max_z = 1.0e4;
-
-    CLOG(LINFO) << "Generating depth point cloud";
-    try {
-        for(int y = 0; y < depth_xyz.rows; y++)
-        {
-            uchar* rgb_ptr = color.ptr<uchar>(y);
-            for(int x = 0; x < depth_xyz.cols; x++)
-            {
-                cv::Vec3f point = depth_xyz.at<cv::Vec3f>(y, x);
-                if(fabs(point[2] - max_z) < FLT_EPSILON || fabs(point[2]) > max_z) continue;
-
-
-                //Get RGB info
-                pb = rgb_ptr[3*x];
-                pg = rgb_ptr[3*x+1];
-                pr = rgb_ptr[3*x+2];
-
-                //Insert info into point cloud structure
-                pcl::PointXYZRGB point1;
-                point1.x = point[0];
-                point1.y = point[1];
-                point1.z = point[2];
-                uint32_t rgb = (static_cast<uint32_t>(pr) << 16 | static_cast<uint32_t>(pg) << 8 | static_cast<uint32_t>(pb));
-                point1.rgb = *reinterpret_cast<float*>(&rgb);
-                cloud->push_back(point1);
-            }
-        }
-
-    } catch (...)
-    {
-        CLOG(LERROR) << "Error occurred in processing input";
-    }
-
-    if(prop_remove_nan){
-        std::vector<int> indices;
-        cloud->is_dense = false;
-        pcl::removeNaNFromPointCloud(*cloud, *cloud, indices);
-    }
-
-    out_cloud_xyzrgb.write(cloud);
+    typedef XYZRows<pcl::PointXYZRGB> XYZ;
+    XYZ xyz_rows(depth_xyz, grid);
+    ColoredRows<XYZ, pcl::PointXYZRGB> rows(xyz_rows, color, colorMap(color, grid));
+    out_cloud_xyzrgb.write(assemble<pcl::PointXYZRGB>(rows, grid));
 }
 
 void DepthConverter::process_depth_xyz_mask() {
     CLOG(LTRACE) << "DepthConverter::process_depth_xyz_mask()"<<endl;
     cv::Mat depth_xyz = in_depth_xyz.read();
+    PixelGrid grid = samplingGrid(depth_xyz.cols, depth_xyz.rows);
     cv::Mat mask = in_mask.read();
-    mask.convertTo(mask, CV_32F);
-    pcl::PointCloud<pcl::PointXYZ>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZ>);
-
-    const double max_z = 1.0e4;
-    CLOG(LINFO) << "Generating depth point cloud";
-    int cnt = 0;
-    try {
-        for(int y = 0; y < depth_xyz.rows; y++)
-        {
-            for(int x = 0; x < depth_xyz.cols; x++)
-            {
-                if (mask.at<float>(y, x)==0) {
-                    continue;
-                }
-                cv::Vec3f point = depth_xyz.at<cv::Vec3f>(y, x);
-                if(fabs(point[2] - max_z) < FLT_EPSILON || fabs(point[2]) > max_z) continue;
-
-		cnt++;
-                //Insert info into point cloud structure
-                pcl::PointXYZ point1;
-                point1.x = point[0];
-                point1.y = point[1];
-                point1.z = point[2];
-                cloud->push_back(point1);
-            }
-        }
-    } catch (...)
-    {
-        CLOG(LERROR) << "Error occurred in processing input";
-    }
-    
-    CLOG(LINFO) << "Converted points: " << cnt;
-
-
-    if(prop_remove_nan){
-        std::vector<int> indices;
-        cloud->is_dense = false;
-        pcl::removeNaNFromPointCloud(*cloud, *cloud, indices);
-    }
+    mask = toByteMask(mask);
+
+    typedef XYZRows<pcl::PointXYZ> XYZ;
+    XYZ xyz_rows(depth_xyz, grid);
+    MaskedRows<XYZ, pcl::PointXYZ> rows(xyz_rows, mask, grid);
+    pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = assemble<pcl::PointXYZ>(rows, grid, maskRuns(mask, grid));
     CLOG(LINFO) << "Converted points: " << cloud->size();
     out_cloud_xyz.write(cloud);
 }
@@ -473,55 +358,17 @@ void DepthConverter::process_depth_xyz_mask() {
 void DepthConverter::process_depth_xyz_color_mask() {
     CLOG(LTRACE) << "DepthConverter::process_depth_xyz_color_mask()"<<endl;
     cv::Mat depth_xyz = in_depth_xyz.read();
+    PixelGrid grid = samplingGrid(depth_xyz.cols, depth_xyz.rows);
     cv::Mat color = in_color.read();
     cv::Mat mask = in_mask.read();
-    mask.convertTo(mask, CV_32F);
-
-    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGB>());
-    uint32_t pr, pg, pb;
-    const double max_z = 1.0e4;
-
-    CLOG(LINFO) << "Generating depth point cloud";
-    try {
-        for(int y = 0; y < depth_xyz.rows; y++)
-        {
-            uchar* rgb_ptr = color.ptr<uchar>(y);
-            for(int x = 0; x < depth_xyz.cols; x++)
-            {
-                if (mask.at<float>(y, x)==0) {
-                    continue;
-                }
-                cv::Vec3f point = depth_xyz.at<cv::Vec3f>(y, x);
-                if(fabs(point[2] - max_z) < FLT_EPSILON || fabs(point[2]) > max_z) continue;
-
-                //Get RGB info
-                pb = rgb_ptr[3*x];
-                pg = rgb_ptr[3*x+1];
-                pr = rgb_ptr[3*x+2];
-
-                //Insert info into point cloud structure
-                pcl::PointXYZRGB point1;
-                point1.x = point[0];
-                point1.y = point[1];
-                point1.z = point[2];
-                uint32_t rgb = (static_cast<uint32_t>(pr) << 16 | static_cast<uint32_t>(pg) << 8 | static_cast<uint32_t>(pb));
-                point1.rgb = *reinterpret_cast<float*>(&rgb);
-                cloud->push_back(point1);
-            }
-        }
-
-    } catch (...)
-    {
-        CLOG(LERROR) << "Error occurred in processing input";
-    }
-
-    if(prop_remove_nan){
-        std::vector<int> indices;
-        cloud->is_dense = false;
-        pcl::removeNaNFromPointCloud(*cloud, *cloud, indices);
-    }
-
-    out_cloud_xyzrgb.write(cloud);
+    mask = toByteMask(mask);
+
+    typedef XYZRows<pcl::PointXYZRGB> XYZ;
+    typedef MaskedRows<XYZ, pcl::PointXYZRGB> Masked;
+    XYZ xyz_rows(depth_xyz, grid);
+    Masked masked_rows(xyz_rows, mask, grid);
+    ColoredRows<Masked, pcl::PointXYZRGB> rows(masked_rows, color, colorMap(color, grid));
+    out_cloud_xyzrgb.write(assemble<pcl::PointXYZRGB>(rows, grid, maskRuns(mask, grid)));
 }
 
 
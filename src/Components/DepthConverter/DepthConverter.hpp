@@ -19,7 +19,13 @@
 
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
+#include <pcl/PointIndices.h>
 
+#include "RayTable.hpp"
+#include "DepthKernels.hpp"
+#include "CloudPool.hpp"
+#include "MaskRuns.hpp"
+#include "ColorMap.hpp"
 
 
 namespace Processors {
@@ -88,6 +94,9 @@ protected:
 	/// Output data port with XYZRGB cloud.
 	Base::DataStreamOut<pcl::PointCloud<pcl::PointXYZRGB>::Ptr > out_cloud_xyzrgb;
 
+	/// Output data port with indices of pixels the points of compacted cloud come from.
+	Base::DataStreamOut<pcl::PointIndices::Ptr > out_indices;
+
 	// Handler functions.
 	void process_depth_mask();
 	void process_depth();
@@ -101,6 +110,95 @@ protected:
 	void process_depth_xyz_color_mask();
 
 	Base::Property<bool> prop_remove_nan;
+
+	/// Use the vectorized back-projection kernel (if supported by the CPU).
+	Base::Property<bool> prop_simd;
+
+	/// Number of threads converting rows in parallel (0 - one per core).
+	Base::Property<int> prop_threads;
+
+	/// Emit (full image) pixel indices of points when NaNs are removed.
+	Base::Property<bool> prop_indices;
+
+	/// Iterate only over runs of set mask pixels (applies when NaNs are removed).
+	Base::Property<bool> prop_sparse_mask;
+
+	/// Runs of the last mask, buffers reused between frames.
+	MaskRuns mask_runs;
+
+	/// Returns runs of set mask pixels, or NULL if the whole grid should be scanned.
+	const MaskRuns * maskRuns(const cv::Mat & mask, const PixelGrid & grid);
+
+	/// Region of interest (non-positive width/height - up to the image border).
+	Base::Property<int> prop_roi_x;
+	Base::Property<int> prop_roi_y;
+	Base::Property<int> prop_roi_width;
+	Base::Property<int> prop_roi_height;
+
+	/// Only every n-th pixel of every n-th row of the ROI is converted.
+	Base::Property<int> prop_stride;
+
+	/// Fold the lens distortion model of the camera into back-projection rays.
+	Base::Property<bool> prop_undistort;
+
+	/// Returns grid of pixels to be converted for the image of given size.
+	PixelGrid samplingGrid(int cols, int rows) const;
+
+	/// Maximal number of idle output clouds kept for reuse (0 disables recycling).
+	Base::Property<int> prop_pool_size;
+
+	/// Number of idle output clouds currently waiting in the pool (read only).
+	Base::Property<int> prop_pool_depth;
+
+	/// Maximal number of output clouds alive at the same time (read only).
+	Base::Property<int> prop_pool_high_water;
+
+	/// Recycled output clouds.
+	CloudPool<pcl::PointXYZ> pool_xyz;
+	CloudPool<pcl::PointXYZRGB> pool_xyzrgb;
+
+	CloudPool<pcl::PointXYZ> & cloudPool(const pcl::PointXYZ *) { return pool_xyz; }
+	CloudPool<pcl::PointXYZRGB> & cloudPool(const pcl::PointXYZRGB *) { return pool_xyzrgb; }
+
+	/// Publishes pool statistics through properties.
+	template <typename PointT>
+	void updatePoolStats(const CloudPool<PointT> & pool);
+
+	/// Returns number of worker threads to be used.
+	int threadCount() const;
+
+	/// Returns back-projection kernel to be used.
+	BackprojectRowFn backprojectKernel() const {
+		return prop_simd ? backproject_kernel : backprojectRowScalar;
+	}
+
+	/// Rebuilds the ray table if camera info or sampling grid has changed.
+	void updateRays(const Types::CameraInfo & camera_info, const PixelGrid & grid);
+
+	/*!
+	 * Converts rows of the sampling grid into a point cloud.
+	 *
+	 * Without remove_nan an organized cloud (of grid size) is filled in place. Otherwise
+	 * valid points of every row are counted first and then written straight
+	 * to their final positions, so that no intermediate organized cloud
+	 * is created. If mask runs are given, only pixels covered by them are
+	 * visited (compacting mode only).
+	 */
+	template <typename PointT, typename Rows>
+	typename pcl::PointCloud<PointT>::Ptr assemble(const Rows & rows, const PixelGrid & grid,
+			const MaskRuns * runs = NULL);
+
+	/// Back-projection rays, cached between frames with the same camera info.
+	RayTable rays;
+
+	/// Colour pixels of grid cells, cached between frames.
+	ColorMap color_map;
+
+	/// Returns colour pixels of grid cells, rebuilding them if the colour image size or grid has changed.
+	const ColorMap & colorMap(const cv::Mat & color, const PixelGrid & grid);
+
+	/// Back-projection kernel selected at runtime.
+	BackprojectRowFn backproject_kernel;
 };
 
 } //: namespace DepthConverter
@@ -0,0 +1,164 @@
+/*!
+ * \file
+ * \brief Row kernels converting raw depth samples into XYZ coordinates and packing colours.
+ *
+ * All kernels perform exactly the same single precision operations
+ * (one conversion and one multiplication per coordinate), so their results
+ * are bit-identical.
+ */
+
+#include "DepthKernels.hpp"
+
+#include <limits>
+
+#ifdef DEPTHCONVERTER_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef DEPTHCONVERTER_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+namespace Processors {
+namespace DepthConverter {
+
+void backprojectRowScalar(const uint16_t * depth, const float * ray_x, const float * ray_y,
+		float * out, int stride, int n) {
+	const float bad_point = std::numeric_limits<float>::quiet_NaN();
+
+	for (int i = 0; i < n; ++i, out += stride) {
+		float d = depth[i];
+
+		// Missing points denoted by NaNs
+		if (depth[i] == 0) {
+			out[0] = out[1] = out[2] = bad_point;
+		} else {
+			out[0] = d * ray_x[i];
+			out[1] = d * ray_y[i];
+			out[2] = d * 0.001f;
+		}
+		out[3] = 1.0f;
+	}
+}
+
+#ifdef DEPTHCONVERTER_HAVE_SSE2
+
+namespace {
+
+/// Computes four points from four depth values and stores them (x, y, z, 1 each).
+inline void storeFour(__m128 d, const float * ray_x, const float * ray_y, float * out, int stride) {
+	const __m128 nan = _mm_set1_ps(std::numeric_limits<float>::quiet_NaN());
+	const __m128 invalid = _mm_cmpeq_ps(d, _mm_setzero_ps());
+
+	__m128 x = _mm_mul_ps(d, _mm_loadu_ps(ray_x));
+	__m128 y = _mm_mul_ps(d, _mm_loadu_ps(ray_y));
+	__m128 z = _mm_mul_ps(d, _mm_set1_ps(0.001f));
+	__m128 w = _mm_set1_ps(1.0f);
+
+	// Blend NaNs into invalid lanes
+	x = _mm_or_ps(_mm_andnot_ps(invalid, x), _mm_and_ps(invalid, nan));
+	y = _mm_or_ps(_mm_andnot_ps(invalid, y), _mm_and_ps(invalid, nan));
+	z = _mm_or_ps(_mm_andnot_ps(invalid, z), _mm_and_ps(invalid, nan));
+
+	// From SoA to AoS - afterwards every register holds one point
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	_mm_storeu_ps(out, x);
+	_mm_storeu_ps(out + stride, y);
+	_mm_storeu_ps(out + 2 * stride, z);
+	_mm_storeu_ps(out + 3 * stride, w);
+}
+
+} //: namespace
+
+void backprojectRowSSE2(const uint16_t * depth, const float * ray_x, const float * ray_y,
+		float * out, int stride, int n) {
+	const __m128i zero = _mm_setzero_si128();
+
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i d16 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(depth + i));
+		__m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(d16, zero));
+		__m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(d16, zero));
+
+		storeFour(lo, ray_x + i, ray_y + i, out + i * stride, stride);
+		storeFour(hi, ray_x + i + 4, ray_y + i + 4, out + (i + 4) * stride, stride);
+	}
+
+	backprojectRowScalar(depth + i, ray_x + i, ray_y + i, out + i * stride, stride, n - i);
+}
+
+#endif /* DEPTHCONVERTER_HAVE_SSE2 */
+
+#ifdef DEPTHCONVERTER_HAVE_AVX2
+
+__attribute__((target("avx2")))
+void backprojectRowAVX2(const uint16_t * depth, const float * ray_x, const float * ray_y,
+		float * out, int stride, int n) {
+	const __m256 nan = _mm256_set1_ps(std::numeric_limits<float>::quiet_NaN());
+	const __m256 scale = _mm256_set1_ps(0.001f);
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i d16 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(depth + i));
+		__m256 d = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(d16));
+		__m256 invalid = _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_EQ_OQ);
+
+		__m256 x = _mm256_blendv_ps(_mm256_mul_ps(d, _mm256_loadu_ps(ray_x + i)), nan, invalid);
+		__m256 y = _mm256_blendv_ps(_mm256_mul_ps(d, _mm256_loadu_ps(ray_y + i)), nan, invalid);
+		__m256 z = _mm256_blendv_ps(_mm256_mul_ps(d, scale), nan, invalid);
+
+		// Transpose each 128-bit half into four points
+		for (int half = 0; half < 2; ++half) {
+			__m128 px = half ? _mm256_extractf128_ps(x, 1) : _mm256_castps256_ps128(x);
+			__m128 py = half ? _mm256_extractf128_ps(y, 1) : _mm256_castps256_ps128(y);
+			__m128 pz = half ? _mm256_extractf128_ps(z, 1) : _mm256_castps256_ps128(z);
+			__m128 pw = one;
+			_MM_TRANSPOSE4_PS(px, py, pz, pw);
+
+			float * dst = out + (i + 4 * half) * stride;
+			_mm_storeu_ps(dst, px);
+			_mm_storeu_ps(dst + stride, py);
+			_mm_storeu_ps(dst + 2 * stride, pz);
+			_mm_storeu_ps(dst + 3 * stride, pw);
+		}
+	}
+
+	backprojectRowScalar(depth + i, ray_x + i, ray_y + i, out + i * stride, stride, n - i);
+}
+
+#endif /* DEPTHCONVERTER_HAVE_AVX2 */
+
+void packBGRRow(const uint8_t * bgr, const int * cols, float * out, int stride, int n) {
+	uint32_t * dst = reinterpret_cast<uint32_t *>(out);
+
+	if (!cols) {
+		for (int i = 0; i < n; ++i, bgr += 3)
+			dst[i * stride] = 0xff000000u | (uint32_t) bgr[2] << 16 | (uint32_t) bgr[1] << 8 | (uint32_t) bgr[0];
+		return;
+	}
+
+	for (int i = 0; i < n; ++i) {
+		const uint8_t * px = bgr + 3 * cols[i];
+		dst[i * stride] = 0xff000000u | (uint32_t) px[2] << 16 | (uint32_t) px[1] << 8 | (uint32_t) px[0];
+	}
+}
+
+BackprojectRowFn selectBackprojectKernel(const char ** name) {
+#ifdef DEPTHCONVERTER_HAVE_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		if (name) *name = "AVX2";
+		return backprojectRowAVX2;
+	}
+#endif
+#ifdef DEPTHCONVERTER_HAVE_SSE2
+	if (name) *name = "SSE2";
+	return backprojectRowSSE2;
+#endif
+	if (name) *name = "scalar";
+	return backprojectRowScalar;
+}
+
+} //: namespace DepthConverter
+} //: namespace Processors
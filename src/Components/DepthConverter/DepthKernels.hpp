@@ -0,0 +1,79 @@
+/*!
+ * \file
+ * \brief Row kernels converting raw depth samples into XYZ coordinates and packing colours.
+ */
+
+#ifndef DEPTHKERNELS_HPP_
+#define DEPTHKERNELS_HPP_
+
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#define DEPTHCONVERTER_HAVE_SSE2
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DEPTHCONVERTER_HAVE_AVX2
+#endif
+
+namespace Processors {
+namespace DepthConverter {
+
+/*!
+ * Back-projects one row of depth samples.
+ *
+ * For every sample i the point at out + i * stride receives x = d * ray_x[i],
+ * y = d * ray_y[i], z = d * 0.001 and the homogeneous coordinate 1.
+ * Samples with d == 0 are turned into NaN points.
+ *
+ * \param depth raw depth samples (millimetres)
+ * \param ray_x ray x coefficients (see RayTable)
+ * \param ray_y ray y coefficients (see RayTable)
+ * \param out first float of the first output point
+ * \param stride distance between consecutive points, in floats (at least 4)
+ * \param n number of samples
+ */
+typedef void (*BackprojectRowFn)(const uint16_t * depth, const float * ray_x, const float * ray_y,
+		float * out, int stride, int n);
+
+/// Portable implementation, used as a reference and as a fallback.
+void backprojectRowScalar(const uint16_t * depth, const float * ray_x, const float * ray_y,
+		float * out, int stride, int n);
+
+#ifdef DEPTHCONVERTER_HAVE_SSE2
+/// SSE2 implementation, eight samples per iteration.
+void backprojectRowSSE2(const uint16_t * depth, const float * ray_x, const float * ray_y,
+		float * out, int stride, int n);
+#endif
+
+#ifdef DEPTHCONVERTER_HAVE_AVX2
+/// AVX2 implementation (compiled for AVX2 regardless of compiler flags, selected only if the CPU supports it).
+void backprojectRowAVX2(const uint16_t * depth, const float * ray_x, const float * ray_y,
+		float * out, int stride, int n);
+#endif
+
+/*!
+ * Packs one row of BGR pixels into PCL packed RGB values.
+ *
+ * The value of sample i is stored (as uint32_t 0xffRRGGBB, opaque like the
+ * default alpha of pcl points) at out + i * stride.
+ * The loop is branch-free, so that the compiler can vectorize the packing.
+ *
+ * \param bgr first pixel of the colour row (3 bytes per pixel)
+ * \param cols column index of every sample in the colour row, or NULL if samples are consecutive pixels
+ * \param out rgb field of the first output point
+ * \param stride distance between consecutive points, in floats
+ * \param n number of samples
+ */
+void packBGRRow(const uint8_t * bgr, const int * cols, float * out, int stride, int n);
+
+/*!
+ * Returns the fastest kernel supported by the CPU the code is running on.
+ * \param name set to the name of the selected kernel (may be NULL)
+ */
+BackprojectRowFn selectBackprojectKernel(const char ** name = 0);
+
+} //: namespace DepthConverter
+} //: namespace Processors
+
+#endif /* DEPTHKERNELS_HPP_ */
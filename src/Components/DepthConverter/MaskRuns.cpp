@@ -0,0 +1,104 @@
+/*!
+ * \file
+ * \brief Run-length representation of a binary mask.
+ */
+
+#include "MaskRuns.hpp"
+
+#include <cstring>
+
+#include <stdint.h>
+
+namespace Processors {
+namespace DepthConverter {
+
+namespace {
+
+const uint64_t ones = 0x0101010101010101ULL;
+const uint64_t highs = 0x8080808080808080ULL;
+
+inline uint64_t load8(const uint8_t * p) {
+	uint64_t word;
+	memcpy(&word, p, sizeof(word));
+	return word;
+}
+
+/// True if none of the eight bytes is zero.
+inline bool allSet(uint64_t word) {
+	return ((word - ones) & ~word & highs) == 0;
+}
+
+void scanRow(const uint8_t * mask, int width, std::vector<Span> & runs) {
+	runs.clear();
+
+	int u = 0;
+	while (u < width) {
+		// Skip unset pixels
+		while (u + 8 <= width && load8(mask + u) == 0)
+			u += 8;
+		while (u < width && mask[u] == 0)
+			++u;
+		if (u >= width)
+			break;
+
+		// Consume set pixels
+		int begin = u;
+		while (u + 8 <= width && allSet(load8(mask + u)))
+			u += 8;
+		while (u < width && mask[u] != 0)
+			++u;
+
+		runs.push_back(Span(begin, u));
+	}
+}
+
+void scanRowDecimated(const uint8_t * mask, const PixelGrid & grid, std::vector<Span> & runs) {
+	runs.clear();
+
+	int i = 0;
+	while (i < grid.cols) {
+		while (i < grid.cols && mask[grid.u(i)] == 0)
+			++i;
+		if (i >= grid.cols)
+			break;
+
+		int begin = i;
+		while (i < grid.cols && mask[grid.u(i)] != 0)
+			++i;
+
+		runs.push_back(Span(begin, i));
+	}
+}
+
+} //: namespace
+
+void MaskRuns::build(const cv::Mat & mask, const PixelGrid & grid, int threads) {
+	const int rows = grid.rows;
+	runs.resize(rows);
+
+	#pragma omp parallel for num_threads(threads) schedule(static)
+	for (int j = 0; j < rows; ++j) {
+		const uint8_t * mask_row = mask.ptr<uint8_t>(grid.v(j));
+		if (grid.stride == 1)
+			scanRow(mask_row + grid.x0, grid.cols, runs[j]);
+		else
+			scanRowDecimated(mask_row, grid, runs[j]);
+	}
+}
+
+int MaskRuns::count() const {
+	int total = 0;
+	for (size_t v = 0; v < runs.size(); ++v)
+		for (size_t i = 0; i < runs[v].size(); ++i)
+			total += runs[v][i].end - runs[v][i].begin;
+	return total;
+}
+
+cv::Mat toByteMask(const cv::Mat & mask) {
+	if (mask.type() == CV_8UC1 || mask.type() == CV_8SC1)
+		return mask;
+	return mask != 0;
+}
+
+} //: namespace DepthConverter
+} //: namespace Processors
@@ -0,0 +1,63 @@
+/*!
+ * \file
+ * \brief Run-length representation of a binary mask.
+ */
+
+#ifndef MASKRUNS_HPP_
+#define MASKRUNS_HPP_
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "PixelGrid.hpp"
+
+namespace Processors {
+namespace DepthConverter {
+
+/// Half-open range [begin, end) of cells in a single grid row.
+struct Span {
+	Span(int begin_ = 0, int end_ = 0) : begin(begin_), end(end_) {}
+
+	int begin;
+	int end;
+};
+
+/*!
+ * \class MaskRuns
+ * \brief Runs of set pixels of an 8-bit mask, extracted row by row.
+ *
+ * Runs are expressed in cells of the sampled PixelGrid. Without decimation
+ * zero areas are skipped eight pixels at a time, so sparse masks are scanned
+ * at a fraction of the cost of testing every pixel. Row buffers are kept
+ * between frames.
+ */
+class MaskRuns {
+public:
+	/*!
+	 * Extracts runs of non-zero pixels of the (CV_8U or CV_8S) mask.
+	 * \param grid sampled cells of the mask
+	 * \param threads number of threads scanning rows in parallel
+	 */
+	void build(const cv::Mat & mask, const PixelGrid & grid, int threads);
+
+	/// Runs of the given grid row.
+	const std::vector<Span> & row(int j) const { return runs[j]; }
+
+	/// Total number of set cells.
+	int count() const;
+
+private:
+	std::vector<std::vector<Span> > runs;
+};
+
+/*!
+ * Normalizes mask so that it can be accessed as 8-bit image.
+ * Masks of other types are converted (set pixels become 255).
+ */
+cv::Mat toByteMask(const cv::Mat & mask);
+
+} //: namespace DepthConverter
+} //: namespace Processors
+
+#endif /* MASKRUNS_HPP_ */
@@ -0,0 +1,76 @@
+/*!
+ * \file
+ * \brief Grid of image pixels sampled by DepthConverter.
+ */
+
+#ifndef PIXELGRID_HPP_
+#define PIXELGRID_HPP_
+
+#include <algorithm>
+
+namespace Processors {
+namespace DepthConverter {
+
+/*!
+ * \class PixelGrid
+ * \brief Region of interest of the image sampled with a constant stride.
+ *
+ * Cell (i, j) of the grid corresponds to image pixel (u(i), v(j)). The grid
+ * dimensions are the dimensions of the produced organized cloud.
+ */
+struct PixelGrid {
+	PixelGrid() :
+		x0(0), y0(0), stride(1), cols(0), rows(0), image_cols(0), image_rows(0) {
+	}
+
+	/*!
+	 * Creates grid covering the given ROI of the image, clamped to image borders.
+	 * Non-positive ROI width/height extend the ROI to the image border.
+	 */
+	static PixelGrid make(int image_cols, int image_rows, int roi_x, int roi_y, int roi_width, int roi_height, int stride) {
+		PixelGrid grid;
+		grid.image_cols = image_cols;
+		grid.image_rows = image_rows;
+		grid.stride = std::max(1, stride);
+		grid.x0 = std::min(std::max(0, roi_x), image_cols);
+		grid.y0 = std::min(std::max(0, roi_y), image_rows);
+
+		int x1 = roi_width > 0 ? std::min(grid.x0 + roi_width, image_cols) : image_cols;
+		int y1 = roi_height > 0 ? std::min(grid.y0 + roi_height, image_rows) : image_rows;
+		grid.cols = (x1 - grid.x0 + grid.stride - 1) / grid.stride;
+		grid.rows = (y1 - grid.y0 + grid.stride - 1) / grid.stride;
+		return grid;
+	}
+
+	/// Image column of the grid column i.
+	int u(int i) const { return x0 + i * stride; }
+
+	/// Image row of the grid row j.
+	int v(int j) const { return y0 + j * stride; }
+
+	/// Index of the image pixel of the grid cell (i, j).
+	int pixel(int i, int j) const { return v(j) * image_cols + u(i); }
+
+	bool operator==(const PixelGrid & other) const {
+		return x0 == other.x0 && y0 == other.y0 && stride == other.stride &&
+				cols == other.cols && rows == other.rows &&
+				image_cols == other.image_cols && image_rows == other.image_rows;
+	}
+
+	bool operator!=(const PixelGrid & other) const {
+		return !(*this == other);
+	}
+
+	int x0;
+	int y0;
+	int stride;
+	int cols;
+	int rows;
+	int image_cols;
+	int image_rows;
+};
+
+} //: namespace DepthConverter
+} //: namespace Processors
+
+#endif /* PIXELGRID_HPP_ */
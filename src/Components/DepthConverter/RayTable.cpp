@@ -0,0 +1,110 @@
+/*!
+ * \file
+ * \brief Per-pixel back-projection ray lookup table used by DepthConverter.
+ */
+
+#include "RayTable.hpp"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace Processors {
+namespace DepthConverter {
+
+namespace {
+
+/// Returns distortion coefficients, or an empty vector if there is no distortion at all.
+std::vector<double> distortionOf(const Types::CameraInfo & camera_info) {
+	std::vector<double> coeffs;
+	cv::Mat dist = camera_info.distCoeffs();
+	if (dist.empty())
+		return coeffs;
+
+	cv::Mat dist64;
+	dist.convertTo(dist64, CV_64F);
+	bool any = false;
+	for (int r = 0; r < dist64.rows; ++r) {
+		for (int c = 0; c < dist64.cols; ++c) {
+			coeffs.push_back(dist64.at<double>(r, c));
+			any = any || coeffs.back() != 0;
+		}
+	}
+
+	if (!any)
+		coeffs.clear();
+	return coeffs;
+}
+
+} //: namespace
+
+RayTable::RayTable() :
+		fx(0), fy(0), cx(0), cy(0) {
+}
+
+bool RayTable::update(const Types::CameraInfo & camera_info, const PixelGrid & grid_, bool undistort) {
+	std::vector<double> coeffs;
+	if (undistort)
+		coeffs = distortionOf(camera_info);
+
+	if (grid == grid_ && fx == camera_info.fx() && fy == camera_info.fy() &&
+			cx == camera_info.cx() && cy == camera_info.cy() && dist_coeffs == coeffs)
+		return false;
+
+	grid = grid_;
+	fx = camera_info.fx();
+	fy = camera_info.fy();
+	cx = camera_info.cx();
+	cy = camera_info.cy();
+	dist_coeffs = coeffs;
+
+	if (dist_coeffs.empty())
+		rebuild();
+	else
+		rebuildUndistorted(camera_info.cameraMatrix());
+	return true;
+}
+
+void RayTable::rebuild() {
+	ray_x.resize(grid.cols * grid.rows);
+	ray_y.resize(grid.cols * grid.rows);
+
+	// Depth is given in millimetres, so the scale is folded into the rays.
+	double fx_d = 0.001 / fx;
+	double fy_d = 0.001 / fy;
+
+	for (int j = 0; j < grid.rows; ++j) {
+		float * rx = &ray_x[j * grid.cols];
+		float * ry = &ray_y[j * grid.cols];
+		float y = (grid.v(j) - cy) * fy_d;
+		for (int i = 0; i < grid.cols; ++i) {
+			rx[i] = (grid.u(i) - cx) * fx_d;
+			ry[i] = y;
+		}
+	}
+}
+
+void RayTable::rebuildUndistorted(const cv::Mat & camera_matrix) {
+	const int size = grid.cols * grid.rows;
+	ray_x.resize(size);
+	ray_y.resize(size);
+	if (size == 0)
+		return;
+
+	// Pixel coordinates of all grid cells
+	cv::Mat pixels(size, 1, CV_64FC2);
+	for (int j = 0; j < grid.rows; ++j)
+		for (int i = 0; i < grid.cols; ++i)
+			pixels.at<cv::Vec2d>(j * grid.cols + i) = cv::Vec2d(grid.u(i), grid.v(j));
+
+	// Normalized coordinates of undistorted rays (z = 1)
+	cv::Mat normalized;
+	cv::undistortPoints(pixels, normalized, camera_matrix, cv::Mat(dist_coeffs));
+
+	for (int k = 0; k < size; ++k) {
+		const cv::Vec2d & ray = normalized.at<cv::Vec2d>(k);
+		ray_x[k] = ray[0] * 0.001;
+		ray_y[k] = ray[1] * 0.001;
+	}
+}
+
+} //: namespace DepthConverter
+} //: namespace Processors
@@ -0,0 +1,67 @@
+/*!
+ * \file
+ * \brief Per-pixel back-projection ray lookup table used by DepthConverter.
+ */
+
+#ifndef RAYTABLE_HPP_
+#define RAYTABLE_HPP_
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include <Types/CameraInfo.hpp>
+
+#include "PixelGrid.hpp"
+
+namespace Processors {
+namespace DepthConverter {
+
+/*!
+ * \class RayTable
+ * \brief Cache of per-pixel ray coefficients.
+ *
+ * For every cell of the sampled pixel grid stores the factors that multiplied
+ * by the raw depth value (in millimetres) give the x and y coordinates (in metres).
+ * Optionally the lens distortion model is folded into the rays, so that
+ * undistorted back-projection costs nothing per frame.
+ * The table is rebuilt only when camera info or the grid change.
+ */
+class RayTable {
+public:
+	RayTable();
+
+	/*!
+	 * Rebuilds the table if the given camera info or grid differs from the cached one.
+	 * \param undistort whether distortion coefficients of the camera should be applied
+	 * \returns true if the table was rebuilt.
+	 */
+	bool update(const Types::CameraInfo & camera_info, const PixelGrid & grid, bool undistort);
+
+	/// Ray x coefficients of the given grid row.
+	const float * rowX(int j) const { return &ray_x[j * grid.cols]; }
+
+	/// Ray y coefficients of the given grid row.
+	const float * rowY(int j) const { return &ray_y[j * grid.cols]; }
+
+private:
+	void rebuild();
+	void rebuildUndistorted(const cv::Mat & camera_matrix);
+
+	std::vector<float> ray_x;
+	std::vector<float> ray_y;
+
+	PixelGrid grid;
+	double fx;
+	double fy;
+	double cx;
+	double cy;
+
+	/// Distortion coefficients folded into the rays (empty for pinhole model).
+	std::vector<double> dist_coeffs;
+};
+
+} //: namespace DepthConverter
+} //: namespace Processors
+
+#endif /* RAYTABLE_HPP_ */
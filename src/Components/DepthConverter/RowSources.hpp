@@ -0,0 +1,197 @@
+/*!
+ * \file
+ * \brief Row sources used by DepthConverter to assemble point clouds.
+ *
+ * Every row source works on cells of a PixelGrid and provides two operations:
+ *  - fill(j, begin, end, out) - writes cells [begin, end) of grid row j
+ *    as points (out corresponds to cell begin), invalid ones as NaNs,
+ *  - valid(j, i) - tells whether cell (i, j) yields a valid point.
+ * Sources can be stacked (e.g. depth + mask + colour), so that every handler
+ * of the component shares the same (possibly parallel and compacting) loop.
+ */
+
+#ifndef ROWSOURCES_HPP_
+#define ROWSOURCES_HPP_
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+
+#include <opencv2/core/core.hpp>
+
+#include <pcl/point_types.h>
+
+#include "PixelGrid.hpp"
+#include "RayTable.hpp"
+#include "DepthKernels.hpp"
+#include "ColorMap.hpp"
+
+namespace Processors {
+namespace DepthConverter {
+
+/*!
+ * \class DepthRows
+ * \brief Back-projects raw (16-bit, millimetre) depth image using cached rays.
+ */
+template <typename PointT>
+class DepthRows {
+public:
+	DepthRows(const cv::Mat & depth_, const PixelGrid & grid_, const RayTable & rays_, BackprojectRowFn backproject_) :
+		depth(depth_), grid(grid_), rays(rays_), backproject(backproject_) {
+	}
+
+	void fill(int j, int begin, int end, PointT * out) const {
+		const int stride = sizeof(PointT) / sizeof(float);
+		const uint16_t * depth_row = depth.ptr<uint16_t>(grid.v(j));
+		const float * ray_x = rays.rowX(j);
+		const float * ray_y = rays.rowY(j);
+
+		if (grid.stride == 1) {
+			backproject(depth_row + grid.u(begin), ray_x + begin, ray_y + begin,
+					out->data, stride, end - begin);
+			return;
+		}
+
+		// Gather decimated samples into a contiguous chunk for the kernel.
+		const int chunk = 256;
+		uint16_t samples[chunk];
+		for (int i = begin; i < end; i += chunk) {
+			const int n = std::min(chunk, end - i);
+			for (int k = 0; k < n; ++k)
+				samples[k] = depth_row[grid.u(i + k)];
+			backproject(samples, ray_x + i, ray_y + i, out[i - begin].data, stride, n);
+		}
+	}
+
+	bool valid(int j, int i) const {
+		return depth.ptr<uint16_t>(grid.v(j))[grid.u(i)] != 0;
+	}
+
+private:
+	const cv::Mat & depth;
+	const PixelGrid & grid;
+	const RayTable & rays;
+	BackprojectRowFn backproject;
+};
+
+/*!
+ * \class XYZRows
+ * \brief Copies points from the depth image already transformed to Cartesian coordinates.
+ */
+template <typename PointT>
+class XYZRows {
+public:
+	XYZRows(const cv::Mat & depth_xyz_, const PixelGrid & grid_) :
+		depth_xyz(depth_xyz_), grid(grid_) {
+	}
+
+	void fill(int j, int begin, int end, PointT * out) const {
+		const float bad_point = std::numeric_limits<float>::quiet_NaN();
+		const cv::Vec3f * xyz_row = depth_xyz.ptr<cv::Vec3f>(grid.v(j));
+		for (int i = begin; i < end; ++i) {
+			const cv::Vec3f & point = xyz_row[grid.u(i)];
+			PointT & pt = out[i - begin];
+			// Missing points denoted by NaNs
+			if (!validPoint(point)) {
+				pt.x = pt.y = pt.z = bad_point;
+				continue;
+			}
+			pt.x = point[0];
+			pt.y = point[1];
+			pt.z = point[2];
+		}
+	}
+
+	bool valid(int j, int i) const {
+		return validPoint(depth_xyz.ptr<cv::Vec3f>(grid.v(j))[grid.u(i)]);
+	}
+
+private:
+	static bool validPoint(const cv::Vec3f & point) {
+		const float max_z = 1.0e4;
+		if (std::fabs(point[2] - max_z) < FLT_EPSILON || std::fabs(point[2]) > max_z)
+			return false;
+		// NaN compares false to everything, so this also rejects non-finite values
+		return point[0] == point[0] && point[1] == point[1] && point[2] == point[2];
+	}
+
+	const cv::Mat & depth_xyz;
+	const PixelGrid & grid;
+};
+
+/*!
+ * \class MaskedRows
+ * \brief Rejects points outside of the 8-bit mask (see toByteMask).
+ */
+template <typename Source, typename PointT>
+class MaskedRows {
+public:
+	MaskedRows(const Source & source_, const cv::Mat & mask_, const PixelGrid & grid_) :
+		source(source_), mask(mask_), grid(grid_) {
+	}
+
+	void fill(int j, int begin, int end, PointT * out) const {
+		const float bad_point = std::numeric_limits<float>::quiet_NaN();
+		source.fill(j, begin, end, out);
+
+		// Points outside of the mask denoted by NaNs
+		const uint8_t * mask_row = mask.ptr<uint8_t>(grid.v(j));
+		for (int i = begin; i < end; ++i) {
+			if (mask_row[grid.u(i)] == 0)
+				out[i - begin].x = out[i - begin].y = out[i - begin].z = bad_point;
+		}
+	}
+
+	bool valid(int j, int i) const {
+		return mask.ptr<uint8_t>(grid.v(j))[grid.u(i)] != 0 && source.valid(j, i);
+	}
+
+private:
+	const Source & source;
+	const cv::Mat & mask;
+	const PixelGrid & grid;
+};
+
+/*!
+ * \class ColoredRows
+ * \brief Fills in packed RGB fields from the (BGR) colour image.
+ *
+ * Colours are packed a row at a time by packBGRRow, with the colour pixel
+ * of every cell taken from the ColorMap.
+ */
+template <typename Source, typename PointT>
+class ColoredRows {
+public:
+	ColoredRows(const Source & source_, const cv::Mat & color_, const ColorMap & map_) :
+		source(source_), color(color_), map(map_) {
+	}
+
+	void fill(int j, int begin, int end, PointT * out) const {
+		source.fill(j, begin, end, out);
+		if (begin >= end)
+			return;
+
+		const uint8_t * color_row = color.ptr<uint8_t>(map.row(j));
+		const int * cols = map.cols();
+		const int stride = sizeof(PointT) / sizeof(float);
+		if (cols)
+			packBGRRow(color_row, cols + begin, &out->rgb, stride, end - begin);
+		else
+			packBGRRow(color_row + 3 * map.col(begin), NULL, &out->rgb, stride, end - begin);
+	}
+
+	bool valid(int j, int i) const {
+		return source.valid(j, i);
+	}
+
+private:
+	const Source & source;
+	const cv::Mat & color;
+	const ColorMap & map;
+};
+
+} //: namespace DepthConverter
+} //: namespace Processors
+
+#endif /* ROWSOURCES_HPP_ */
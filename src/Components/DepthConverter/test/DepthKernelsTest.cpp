@@ -0,0 +1,178 @@
+/*!
+ * \file
+ * \brief Checks back-projection kernels against each other and against the original double precision conversion.
+ *
+ * SIMD kernels must give results bit-identical to the scalar one. The scalar
+ * kernel (single precision rays) must stay within float rounding of the
+ * original per-pixel double precision formula. Packed colours must match
+ * pcl::PointXYZRGB (opaque alpha).
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "DepthKernels.hpp"
+
+using namespace Processors::DepthConverter;
+
+namespace {
+
+const int width = 637;
+const int height = 3;
+const double fx = 525.0, fy = 524.0, cx = 319.5, cy = 239.5;
+
+/// Marks floats which kernels must not touch.
+const float untouched = -12345.0f;
+
+int failures = 0;
+
+void fail(const char * what, int v, int u, int c, float got, float expected) {
+	if (++failures <= 10)
+		std::printf("FAIL %s: row %d, col %d, coord %d: got %.9g, expected %.9g\n", what, v, u, c, got, expected);
+}
+
+bool same(float a, float b) {
+	return std::memcmp(&a, &b, sizeof(float)) == 0 || (a != a && b != b);
+}
+
+/// Depth samples with zeros, small and maximal values.
+std::vector<uint16_t> makeDepth() {
+	std::vector<uint16_t> depth(width * height);
+	std::srand(1);
+	for (size_t i = 0; i < depth.size(); ++i) {
+		const int r = std::rand() % 10;
+		depth[i] = r == 0 ? 0 : r == 1 ? 65535 : (uint16_t) (300 + std::rand() % 9000);
+	}
+	return depth;
+}
+
+/// Rays computed the way RayTable does (pinhole model).
+void makeRays(std::vector<float> & ray_x, std::vector<float> & ray_y) {
+	ray_x.resize(width * height);
+	ray_y.resize(width * height);
+	const double fx_d = 0.001 / fx, fy_d = 0.001 / fy;
+	for (int v = 0; v < height; ++v) {
+		for (int u = 0; u < width; ++u) {
+			ray_x[v * width + u] = (u - cx) * fx_d;
+			ray_y[v * width + u] = (v - cy) * fy_d;
+		}
+	}
+}
+
+/// Converts all rows with the kernel, points stride floats apart.
+std::vector<float> convert(BackprojectRowFn kernel, const std::vector<uint16_t> & depth,
+		const std::vector<float> & ray_x, const std::vector<float> & ray_y, int stride) {
+	std::vector<float> out(width * height * stride, untouched);
+	for (int v = 0; v < height; ++v)
+		kernel(&depth[v * width], &ray_x[v * width], &ray_y[v * width], &out[v * width * stride], stride, width);
+	return out;
+}
+
+void compareExact(const char * name, const std::vector<float> & got, const std::vector<float> & expected, int stride) {
+	for (int v = 0; v < height; ++v)
+		for (int u = 0; u < width; ++u)
+			for (int c = 0; c < stride; ++c) {
+				const int k = (v * width + u) * stride + c;
+				if (!same(got[k], expected[k]))
+					fail(name, v, u, c, got[k], expected[k]);
+			}
+}
+
+/// Compares with the original conversion: (u - cx) * depth * (0.001 / fx) in double precision.
+void compareOriginal(const std::vector<float> & got, const std::vector<uint16_t> & depth, int stride) {
+	const double fx_d = 0.001 / fx, fy_d = 0.001 / fy;
+	// Two float roundings (ray and product) against a single one
+	const double tolerance = 4e-7;
+
+	for (int v = 0; v < height; ++v) {
+		for (int u = 0; u < width; ++u) {
+			const int d = depth[v * width + u];
+			const float * p = &got[(v * width + u) * stride];
+			float expected[4];
+			if (d == 0) {
+				expected[0] = expected[1] = expected[2] = NAN;
+			} else {
+				expected[0] = (u - cx) * d * fx_d;
+				expected[1] = (v - cy) * d * fy_d;
+				expected[2] = d * 0.001;
+			}
+			expected[3] = 1.0f;
+
+			for (int c = 0; c < 4; ++c) {
+				const bool ok = d == 0 && c < 3 ? p[c] != p[c] :
+						std::fabs(p[c] - expected[c]) <= tolerance * std::fabs(expected[c]) + 1e-9;
+				if (!ok)
+					fail("scalar vs original", v, u, c, p[c], expected[c]);
+			}
+			for (int c = 4; c < stride; ++c)
+				if (p[c] != untouched)
+					fail("scalar padding", v, u, c, p[c], untouched);
+		}
+	}
+}
+
+/// Packs colours both of consecutive and of mapped pixels, compares with the pcl layout.
+void checkColours() {
+	const int n = 37;
+	const int stride = 8;
+	std::vector<uint8_t> bgr(3 * n);
+	std::vector<int> cols(n);
+	for (int i = 0; i < n; ++i) {
+		bgr[3 * i] = (uint8_t) (7 * i);
+		bgr[3 * i + 1] = (uint8_t) (255 - i);
+		bgr[3 * i + 2] = (uint8_t) (100 + i);
+		cols[i] = n - 1 - i;
+	}
+
+	for (int mapped = 0; mapped < 2; ++mapped) {
+		std::vector<float> out(n * stride, untouched);
+		packBGRRow(&bgr[0], mapped ? &cols[0] : NULL, &out[0], stride, n);
+		for (int i = 0; i < n; ++i) {
+			const uint8_t * px = &bgr[3 * (mapped ? cols[i] : i)];
+			const uint32_t expected = 255u << 24 | (uint32_t) px[2] << 16 | (uint32_t) px[1] << 8 | px[0];
+			uint32_t got;
+			std::memcpy(&got, &out[i * stride], sizeof(got));
+			if (got != expected)
+				fail(mapped ? "packBGRRow (mapped)" : "packBGRRow", 0, i, 0, got, expected);
+			if (out[i * stride + 1] != untouched)
+				fail("packBGRRow padding", 0, i, 1, out[i * stride + 1], untouched);
+		}
+	}
+}
+
+} //: namespace
+
+int main() {
+	const std::vector<uint16_t> depth = makeDepth();
+	std::vector<float> ray_x, ray_y;
+	makeRays(ray_x, ray_y);
+
+	// PointXYZ and PointXYZRGB layouts
+	const int strides[] = { 4, 8 };
+	for (int s = 0; s < 2; ++s) {
+		const int stride = strides[s];
+		const std::vector<float> scalar = convert(backprojectRowScalar, depth, ray_x, ray_y, stride);
+		compareOriginal(scalar, depth, stride);
+
+#ifdef DEPTHCONVERTER_HAVE_SSE2
+		compareExact("SSE2 vs scalar", convert(backprojectRowSSE2, depth, ray_x, ray_y, stride), scalar, stride);
+#endif
+#ifdef DEPTHCONVERTER_HAVE_AVX2
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			compareExact("AVX2 vs scalar", convert(backprojectRowAVX2, depth, ray_x, ray_y, stride), scalar, stride);
+		else
+			std::printf("AVX2 not supported by the CPU, skipped\n");
+#endif
+	}
+
+	checkColours();
+
+	const char * name = 0;
+	selectBackprojectKernel(&name);
+	std::printf("Selected kernel: %s, failures: %d\n", name, failures);
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,365 @@
+/*!
+ * \file
+ * \brief Single-pass crop tests (axis-aligned box, oriented box, prism) used by PassThrough.
+ */
+
+#ifndef BOXFILTER_HPP_
+#define BOXFILTER_HPP_
+
+#include <vector>
+#include <limits>
+#include <string>
+#include <sstream>
+#include <algorithm>
+
+#include <stdint.h>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_traits.h>
+
+#include <Eigen/Core>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PASSTHROUGH_HAVE_SSE2
+#endif
+
+namespace Processors {
+namespace PassThrough {
+
+/*!
+ * \class Box
+ * \brief Limits of the three coordinates, each possibly negated.
+ *
+ * Point passes the filter if it is finite and, for every axis, its
+ * coordinate lies within [min, max] (or outside of it, if the axis is
+ * negative) - exactly as after three consecutive pcl::PassThrough filters.
+ */
+struct Box {
+	Box() {
+		for (int a = 0; a < 3; ++a) {
+			min[a] = max[a] = 0;
+			negative[a] = false;
+		}
+	}
+
+	void setAxis(int axis, float min_, float max_, bool negative_) {
+		min[axis] = min_;
+		max[axis] = max_;
+		negative[axis] = negative_;
+	}
+
+	/// Tests coordinates of a single point (scalar version).
+	bool contains(const float * p) const {
+		for (int a = 0; a < 3; ++a) {
+			if (!(p[a] - p[a] == 0))
+				return false; // NaN or infinity
+			if ((p[a] >= min[a] && p[a] <= max[a]) == negative[a])
+				return false;
+		}
+		return true;
+	}
+
+	float min[3];
+	float max[3];
+	bool negative[3];
+};
+
+/*!
+ * \class Coordinates
+ * \brief Compile-time access to coordinates of any registered point type.
+ *
+ * Offsets come from PCL point traits, so no field lookup by name nor copying
+ * is needed at run time.
+ */
+template <typename PointT>
+struct Coordinates {
+	static const size_t x = pcl::traits::offset<PointT, pcl::fields::x>::value;
+	static const size_t y = pcl::traits::offset<PointT, pcl::fields::y>::value;
+	static const size_t z = pcl::traits::offset<PointT, pcl::fields::z>::value;
+
+	/// True if x, y, z are followed by (at least) one float - all four can be loaded at once.
+	static const bool packed = y == x + sizeof(float) && z == y + sizeof(float) && z + 2 * sizeof(float) <= sizeof(PointT);
+
+	static float get(const PointT & point, size_t offset) {
+		return *reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(&point) + offset);
+	}
+
+	static const float * first(const PointT & point) {
+		return reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(&point) + x);
+	}
+
+	/// Turns the point into NaN point.
+	static void invalidate(PointT & point) {
+		uint8_t * data = reinterpret_cast<uint8_t *>(&point);
+		const float nan = std::numeric_limits<float>::quiet_NaN();
+		*reinterpret_cast<float *>(data + x) = nan;
+		*reinterpret_cast<float *>(data + y) = nan;
+		*reinterpret_cast<float *>(data + z) = nan;
+	}
+};
+
+/*!
+ * \class IndexSink
+ * \brief Collects indices of points passing the test.
+ *
+ * Every scan below reports the result of the test of every point to a sink,
+ * so the same single pass can either list the points or mark the others.
+ */
+class IndexSink {
+public:
+	IndexSink(std::vector<int> & indices_, int n) : indices(indices_), count(0) {
+		indices.resize(n);
+	}
+
+	/// Branch-free append - index is always written, counter advanced only on success.
+	void operator()(int i, bool pass) {
+		indices[count] = i;
+		count += pass;
+	}
+
+	void finish() {
+		indices.resize(count);
+	}
+
+private:
+	std::vector<int> & indices;
+	int count;
+};
+
+/*!
+ * \class OrganizedSink
+ * \brief Copies points into a new cloud of the same size, with NaNs in place of points failing the test.
+ *
+ * Scans report points in order, so every output point is written exactly once.
+ */
+template <typename PointT>
+class OrganizedSink {
+public:
+	OrganizedSink(const pcl::PointCloud<PointT> & input_, pcl::PointCloud<PointT> & output_) : input(input_), output(output_) {
+		output.header = input.header;
+		output.width = input.width;
+		output.height = input.height;
+		output.sensor_origin_ = input.sensor_origin_;
+		output.sensor_orientation_ = input.sensor_orientation_;
+		output.points.clear();
+		output.points.reserve(input.points.size());
+	}
+
+	void operator()(int i, bool pass) {
+		output.points.push_back(input.points[i]);
+		if (!pass)
+			Coordinates<PointT>::invalidate(output.points.back());
+	}
+
+	void finish() {
+		output.is_dense = false;
+	}
+
+private:
+	const pcl::PointCloud<PointT> & input;
+	pcl::PointCloud<PointT> & output;
+};
+
+/*!
+ * Tests whether points of the cloud lie in the box, in a single pass.
+ *
+ * If coordinates are stored next to each other (as with PCL_ADD_POINT4D),
+ * they are tested with one vector comparison per point.
+ */
+template <typename PointT, typename Sink>
+void boxScan(const pcl::PointCloud<PointT> & cloud, const Box & box, Sink & sink) {
+	typedef Coordinates<PointT> C;
+
+	const int n = cloud.points.size();
+
+#ifdef PASSTHROUGH_HAVE_SSE2
+	if (C::packed) {
+		const __m128 lo = _mm_setr_ps(box.min[0], box.min[1], box.min[2], 0);
+		const __m128 hi = _mm_setr_ps(box.max[0], box.max[1], box.max[2], 0);
+		const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+		const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		const int negative = (box.negative[0] ? 1 : 0) | (box.negative[1] ? 2 : 0) | (box.negative[2] ? 4 : 0);
+
+		for (int i = 0; i < n; ++i) {
+			const __m128 p = _mm_loadu_ps(C::first(cloud.points[i]));
+			const int finite = _mm_movemask_ps(_mm_cmplt_ps(_mm_and_ps(p, abs_mask), inf));
+			const int inside = _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(p, lo), _mm_cmple_ps(p, hi)));
+			sink(i, ((finite & 7) == 7) & (((inside ^ negative) & 7) == 7));
+		}
+
+		sink.finish();
+		return;
+	}
+#endif
+
+	for (int i = 0; i < n; ++i) {
+		const PointT & point = cloud.points[i];
+		const float p[3] = { C::get(point, C::x), C::get(point, C::y), C::get(point, C::z) };
+		sink(i, box.contains(p));
+	}
+
+	sink.finish();
+}
+
+/*!
+ * \class Frame
+ * \brief Rigid transformation from the sensor frame into the crop frame.
+ *
+ * Only the top three rows of the matrix are kept, column by column, so that
+ * a point is transformed with three multiply-adds of whole columns.
+ */
+struct Frame {
+	/// Creates frame of the crop volume placed at the given pose (in the sensor frame).
+	explicit Frame(const Eigen::Matrix4f & pose) {
+		const Eigen::Matrix4f m = pose.inverse();
+		for (int c = 0; c < 4; ++c) {
+			for (int r = 0; r < 3; ++r)
+				col[c][r] = m(r, c);
+			col[c][3] = 0;
+		}
+	}
+
+	/// Transforms coordinates of a single point (scalar version).
+	void apply(const float * p, float * q) const {
+		for (int r = 0; r < 3; ++r)
+			q[r] = col[0][r] * p[0] + col[1][r] * p[1] + col[2][r] * p[2] + col[3][r];
+	}
+
+	float col[4][4];
+};
+
+/*!
+ * \class Polygon
+ * \brief Closed polygon in the XY plane of the crop frame.
+ */
+class Polygon {
+public:
+	/// Parses list of vertices, e.g. "0 0; 1 0; 1 1" (separators: spaces, commas, semicolons).
+	explicit Polygon(const std::string & vertices) {
+		std::string text = vertices;
+		std::replace(text.begin(), text.end(), ';', ' ');
+		std::replace(text.begin(), text.end(), ',', ' ');
+		std::istringstream iss(text);
+		float x, y;
+		while (iss >> x >> y) {
+			xs.push_back(x);
+			ys.push_back(y);
+		}
+
+		min_x = max_x = min_y = max_y = 0;
+		if (!xs.empty()) {
+			min_x = *std::min_element(xs.begin(), xs.end());
+			max_x = *std::max_element(xs.begin(), xs.end());
+			min_y = *std::min_element(ys.begin(), ys.end());
+			max_y = *std::max_element(ys.begin(), ys.end());
+		}
+	}
+
+	/// Number of vertices.
+	int size() const { return xs.size(); }
+
+	/// Crossing number test (points on the boundary are not handled specially).
+	bool contains(float x, float y) const {
+		if (x < min_x || x > max_x || y < min_y || y > max_y)
+			return false;
+
+		bool inside = false;
+		const int n = xs.size();
+		for (int i = 0, j = n - 1; i < n; j = i++) {
+			if ((ys[i] > y) != (ys[j] > y) &&
+					x < (xs[j] - xs[i]) * (y - ys[i]) / (ys[j] - ys[i]) + xs[i])
+				inside = !inside;
+		}
+		return inside;
+	}
+
+private:
+	std::vector<float> xs;
+	std::vector<float> ys;
+	float min_x, max_x, min_y, max_y;
+};
+
+/*!
+ * Tests whether points lie in the box placed in the given frame, in a single pass.
+ *
+ * Points are tested in the crop frame - they are transformed on the fly,
+ * no transformed cloud is created.
+ */
+template <typename PointT, typename Sink>
+void orientedBoxScan(const pcl::PointCloud<PointT> & cloud, const Box & box, const Frame & frame, Sink & sink) {
+	typedef Coordinates<PointT> C;
+
+	const int n = cloud.points.size();
+
+#ifdef PASSTHROUGH_HAVE_SSE2
+	if (C::packed) {
+		const __m128 c0 = _mm_loadu_ps(frame.col[0]);
+		const __m128 c1 = _mm_loadu_ps(frame.col[1]);
+		const __m128 c2 = _mm_loadu_ps(frame.col[2]);
+		const __m128 c3 = _mm_loadu_ps(frame.col[3]);
+		const __m128 lo = _mm_setr_ps(box.min[0], box.min[1], box.min[2], 0);
+		const __m128 hi = _mm_setr_ps(box.max[0], box.max[1], box.max[2], 0);
+		const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+		const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		const int negative = (box.negative[0] ? 1 : 0) | (box.negative[1] ? 2 : 0) | (box.negative[2] ? 4 : 0);
+
+		for (int i = 0; i < n; ++i) {
+			const __m128 p = _mm_loadu_ps(C::first(cloud.points[i]));
+			__m128 q = _mm_add_ps(_mm_mul_ps(c0, _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0))), c3);
+			q = _mm_add_ps(q, _mm_mul_ps(c1, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1))));
+			q = _mm_add_ps(q, _mm_mul_ps(c2, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2))));
+
+			const int finite = _mm_movemask_ps(_mm_cmplt_ps(_mm_and_ps(p, abs_mask), inf));
+			const int inside = _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(q, lo), _mm_cmple_ps(q, hi)));
+			sink(i, ((finite & 7) == 7) & (((inside ^ negative) & 7) == 7));
+		}
+
+		sink.finish();
+		return;
+	}
+#endif
+
+	for (int i = 0; i < n; ++i) {
+		const PointT & point = cloud.points[i];
+		const float p[3] = { C::get(point, C::x), C::get(point, C::y), C::get(point, C::z) };
+		float q[3];
+		frame.apply(p, q);
+		sink(i, pcl_isfinite(p[0]) && pcl_isfinite(p[1]) && pcl_isfinite(p[2]) && box.contains(q));
+	}
+
+	sink.finish();
+}
+
+/*!
+ * Tests whether points lie in the prism (polygon extruded along z
+ * between min_z and max_z) placed in the given frame, in a single pass.
+ */
+template <typename PointT, typename Sink>
+void prismScan(const pcl::PointCloud<PointT> & cloud, const Polygon & polygon, float min_z, float max_z,
+		const Frame & frame, Sink & sink) {
+	typedef Coordinates<PointT> C;
+
+	const int n = cloud.points.size();
+
+	for (int i = 0; i < n; ++i) {
+		const PointT & point = cloud.points[i];
+		const float p[3] = { C::get(point, C::x), C::get(point, C::y), C::get(point, C::z) };
+		if (!pcl_isfinite(p[0]) || !pcl_isfinite(p[1]) || !pcl_isfinite(p[2])) {
+			sink(i, false);
+			continue;
+		}
+
+		float q[3];
+		frame.apply(p, q);
+		sink(i, q[2] >= min_z && q[2] <= max_z && polygon.contains(q[0], q[1]));
+	}
+
+	sink.finish();
+}
+
+} //: namespace PassThrough
+} //: namespace Processors
+
+#endif /* BOXFILTER_HPP_ */
@@ -12,6 +12,8 @@
 
 #include <boost/bind.hpp>
 
+#include <pcl/common/io.h>
+
 namespace Processors {
 namespace PassThrough {
 
@@ -25,7 +27,12 @@ PassThrough::PassThrough(const std::string & name) :
         zb("z.b", 0),
         negative_x("negative_x", false),
         negative_y("negative_y", false),
-        negative_z("negative_z", false){
+        negative_z("negative_z", false),
+        mode("mode", std::string("box")),
+        polygon("polygon", std::string("")),
+        indices_only("indices_only", false),
+        keep_organized("keep_organized", false),
+        pose(Eigen::Matrix4f::Identity()){
         registerProperty(xa);
         registerProperty(xb);
         registerProperty(ya);
@@ -35,6 +42,10 @@ PassThrough::PassThrough(const std::string & name) :
         registerProperty(negative_x);
         registerProperty(negative_y);
         registerProperty(negative_z);
+        registerProperty(mode);
+        registerProperty(polygon);
+        registerProperty(indices_only);
+        registerProperty(keep_organized);
 
 }
 
@@ -46,9 +57,15 @@ void PassThrough::prepareInterface() {
     registerStream("in_cloud_xyz", &in_cloud_xyz);
     registerStream("in_cloud_xyzrgb", &in_cloud_xyzrgb);
     registerStream("in_cloud_xyzsift", &in_cloud_xyzsift);
+    registerStream("in_cloud_xyzshot", &in_cloud_xyzshot);
+    registerStream("in_cloud_xyzrgb_normal", &in_cloud_xyzrgb_normal);
+    registerStream("in_pose", &in_pose);
     registerStream("out_cloud_xyz", &out_cloud_xyz);
     registerStream("out_cloud_xyzrgb", &out_cloud_xyzrgb);
     registerStream("out_cloud_xyzsift", &out_cloud_xyzsift);
+    registerStream("out_cloud_xyzshot", &out_cloud_xyzshot);
+    registerStream("out_cloud_xyzrgb_normal", &out_cloud_xyzrgb_normal);
+    registerStream("out_indices", &out_indices);
     // Register handlers
     registerHandler("filter_xyz", boost::bind(&PassThrough::filter_xyz, this));
     addDependency("filter_xyz", &in_cloud_xyz);
@@ -56,6 +73,10 @@ void PassThrough::prepareInterface() {
     addDependency("filter_xyzrgb", &in_cloud_xyzrgb);
     registerHandler("filter_xyzsift", boost::bind(&PassThrough::filter_xyzsift, this));
     addDependency("filter_xyzsift", &in_cloud_xyzsift);
+    registerHandler("filter_xyzshot", boost::bind(&PassThrough::filter_xyzshot, this));
+    addDependency("filter_xyzshot", &in_cloud_xyzshot);
+    registerHandler("filter_xyzrgb_normal", boost::bind(&PassThrough::filter_xyzrgb_normal, this));
+    addDependency("filter_xyzrgb_normal", &in_cloud_xyzrgb_normal);
 }
 
 bool PassThrough::onInit() {
@@ -75,149 +96,93 @@ bool PassThrough::onStart() {
 	return true;
 }
 
+Box PassThrough::box() const {
+    Box b;
+    b.setAxis(0, xa, xb, negative_x);
+    b.setAxis(1, ya, yb, negative_y);
+    b.setAxis(2, za, zb, negative_z);
+    return b;
+}
+
+template <typename PointT, typename Sink>
+void PassThrough::scan(const pcl::PointCloud<PointT> & cloud, Sink & sink) {
+    if (!in_pose.empty())
+        pose = in_pose.read();
+
+    // Every volume is tested in a single pass, no transformed cloud is created.
+    const std::string crop_mode = mode;
+    if (crop_mode == "oriented_box") {
+        orientedBoxScan(cloud, box(), Frame(pose), sink);
+    } else if (crop_mode == "prism") {
+        Polygon base(polygon);
+        if (base.size() < 3)
+            CLOG(LWARNING) << "PassThrough: prism base needs at least three vertices";
+        prismScan(cloud, base, za, zb, Frame(pose), sink);
+    } else {
+        boxScan(cloud, box(), sink);
+    }
+}
+
+template <typename PointT>
+void PassThrough::crop(const typename pcl::PointCloud<PointT>::Ptr & cloud, Base::DataStreamOut<typename pcl::PointCloud<PointT>::Ptr> & out_cloud) {
+    // Points outside are replaced with NaNs, width and height are kept.
+    // The input cloud may be shared with other components, so the points go to a new cloud, in the same pass.
+    if (keep_organized) {
+        typename pcl::PointCloud<PointT>::Ptr output(new pcl::PointCloud<PointT>());
+        OrganizedSink<PointT> sink(*cloud, *output);
+        scan(*cloud, sink);
+        out_cloud.write(output);
+        return;
+    }
+
+    pcl::PointIndices::Ptr indices(new pcl::PointIndices());
+    indices->header = cloud->header;
+    IndexSink sink(indices->indices, cloud->size());
+    scan(*cloud, sink);
+    CLOG(LTRACE) << "Number of indices: " << indices->indices.size();
+    out_indices.write(indices);
+
+    // Points are not copied at all - receivers use the input cloud with indices.
+    if (indices_only) {
+        out_cloud.write(cloud);
+        return;
+    }
+
+    typename pcl::PointCloud<PointT>::Ptr output(new pcl::PointCloud<PointT>());
+    pcl::copyPointCloud(*cloud, indices->indices, *output);
+    output->is_dense = true;
+    out_cloud.write(output);
+}
+
 void PassThrough::filter_xyz() {
     LOG(LTRACE) <<"PassThrough::filter_xyz()";
     pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = in_cloud_xyz.read();
-    pcl::PassThrough<pcl::PointXYZ> pass;
-    pass.setInputCloud (cloud);
-    pass.setFilterFieldName ("x");
-    pass.setFilterLimits (xa, xb);
-    pass.setFilterLimitsNegative (negative_x);
-    pass.filter (*cloud);
-    pass.setFilterFieldName ("y");
-    pass.setFilterLimits (ya, yb);
-    pass.setFilterLimitsNegative (negative_y);
-    pass.filter (*cloud);
-    pass.setFilterFieldName ("z");
-    pass.setFilterLimits (za, zb);
-    pass.setFilterLimitsNegative (negative_z);
-    pass.filter (*cloud);
-    out_cloud_xyz.write(cloud);
+    crop<pcl::PointXYZ>(cloud, out_cloud_xyz);
 }
 
 void PassThrough::filter_xyzrgb() {
     LOG(LTRACE) <<"PassThrough::filter_xyzrgb()";
     pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = in_cloud_xyzrgb.read();
-    pcl::PassThrough<pcl::PointXYZRGB> pass;
-    pass.setInputCloud (cloud);
-    pass.setFilterFieldName ("x");
-    pass.setFilterLimits (xa, xb);
-    pass.setFilterLimitsNegative (negative_x);
-    pass.filter (*cloud);
-    pass.setFilterFieldName ("y");
-    pass.setFilterLimits (ya, yb);
-    pass.setFilterLimitsNegative (negative_y);
-    pass.filter (*cloud);
-    pass.setFilterFieldName ("z");
-    pass.setFilterLimits (za, zb);
-    pass.setFilterLimitsNegative (negative_z);
-    pass.filter (*cloud);
-    out_cloud_xyzrgb.write(cloud);
+    crop<pcl::PointXYZRGB>(cloud, out_cloud_xyzrgb);
 }
 
 void PassThrough::filter_xyzsift() {
     LOG(LTRACE) <<"PassThrough::filter_xyzsift()";
-        pcl::PointCloud<PointXYZSIFT>::Ptr cloud = in_cloud_xyzsift.read();
-
-        applyFilter(cloud, *cloud, "x", xa, xb, negative_x);
-        applyFilter(cloud, *cloud, "y", ya, yb, negative_y);
-        applyFilter(cloud, *cloud, "z", za, zb, negative_z);
-        out_cloud_xyzsift.write(cloud);
+    pcl::PointCloud<PointXYZSIFT>::Ptr cloud = in_cloud_xyzsift.read();
+    crop<PointXYZSIFT>(cloud, out_cloud_xyzsift);
 }
 
-void PassThrough::applyFilter (pcl::PointCloud<PointXYZSIFT>::Ptr input, pcl::PointCloud<PointXYZSIFT> &output, std::string filter_field_name, float min, float max, bool negative)
-{
-    CLOG(LTRACE) << "PassThrough::applyFilter() " << filter_field_name;
-    output.header = input->header;
-    output.sensor_origin_ = input->sensor_origin_;
-    output.sensor_orientation_ = input->sensor_orientation_;
-
-    std::vector<int> indices;
-
-    output.is_dense = true;
-    applyFilterIndices (indices, input, filter_field_name, min, max, negative);
-    CLOG(LTRACE)<< "Number of indices: "<< indices.size() <<endl;
-    copyPointCloud (*input, indices, output);
-
+void PassThrough::filter_xyzshot() {
+    LOG(LTRACE) <<"PassThrough::filter_xyzshot()";
+    pcl::PointCloud<PointXYZSHOT>::Ptr cloud = in_cloud_xyzshot.read();
+    crop<PointXYZSHOT>(cloud, out_cloud_xyzshot);
 }
 
-void PassThrough::applyFilterIndices (std::vector<int> &indices, pcl::PointCloud<PointXYZSIFT>::Ptr input, std::string filter_field_name, float min, float max, bool negative)
-{
-    CLOG(LTRACE) << "PassThrough::applyFilterIndices() " << filter_field_name;
-    pcl::IndicesPtr indices_(new vector<int>);
-    for(int i = 0; i < input->size(); i++){
-        indices_->push_back(i);
-    }
-
-    // The arrays to be used
-    indices.resize (indices_->size ());
-    int oii = 0; // oii = output indices iterator, rii = removed indices iterator
-    // Has a field name been specified?
-
-    if (filter_field_name.empty ())
-    {
-        // Only filter for non-finite entries then
-        for (int iii = 0; iii < static_cast<int> (indices_->size ()); ++iii) // iii = input indices iterator
-        {
-            // Non-finite entries are always passed to removed indices
-            if (!pcl_isfinite (input->points[(*indices_)[iii]].x) ||
-                    !pcl_isfinite (input->points[(*indices_)[iii]].y) ||
-                    !pcl_isfinite (input->points[(*indices_)[iii]].z))
-            {
-                continue;
-            }
-            indices[oii++] = (*indices_)[iii];
-        }
-    }
-    else
-    {
-        // Attempt to get the field name's index
-        std::vector<pcl::PCLPointField> fields;
-        int distance_idx = pcl::getFieldIndex (*input, filter_field_name, fields);
-        if (distance_idx == -1)
-        {
-            CLOG(LWARNING) << "PassThrough::applyFilterIndices Unable to find field name in point type.";
-            indices.clear ();
-            return;
-        }
-        // Filter for non-finite entries and the specified field limits
-        for (int iii = 0; iii < static_cast<int> (indices_->size ()); ++iii) // iii = input indices iterator
-        {
-            // Non-finite entries are always passed to removed indices
-            if (!pcl_isfinite (input->points[(*indices_)[iii]].x) ||
-                    !pcl_isfinite (input->points[(*indices_)[iii]].y) ||
-                    !pcl_isfinite (input->points[(*indices_)[iii]].z))
-            {
-                continue;
-            }
-            // Get the field's value
-            const uint8_t* pt_data = reinterpret_cast<const uint8_t*> (&input->points[(*indices_)[iii]]);
-            float field_value = 0;
-            memcpy (&field_value, pt_data + fields[distance_idx].offset, sizeof (float));
-            // Remove NAN/INF/-INF values. We expect passthrough to output clean valid data.
-            if (!pcl_isfinite (field_value))
-            {
-                continue;
-            }
-            // Outside of the field limits are passed to removed indices
-            if (!negative && (field_value < min || field_value > max))
-            {
-                continue;
-            }
-            // Inside of the field limits are passed to removed indices if negative was set
-            if (negative && field_value >= min && field_value <= max)
-            {
-                continue;
-            }
-            // Otherwise it was a normal point for output (inlier)
-            indices[oii++] = (*indices_)[iii];
-        }
-    }
-    // Resize the output arrays
-    indices.resize (oii);
+void PassThrough::filter_xyzrgb_normal() {
+    LOG(LTRACE) <<"PassThrough::filter_xyzrgb_normal()";
+    pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud = in_cloud_xyzrgb_normal.read();
+    crop<pcl::PointXYZRGBNormal>(cloud, out_cloud_xyzrgb_normal);
 }
 
-
-
 } //: namespace PassThrough
 } //: namespace Processors
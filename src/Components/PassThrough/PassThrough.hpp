@@ -14,8 +14,12 @@
 #include "EventHandler2.hpp"
 
 #include <pcl/point_types.h>
-#include <pcl/filters/passthrough.h>
+#include <pcl/PointIndices.h>
 #include <Types/PointXYZSIFT.hpp>
+#include <Types/PointXYZSHOT.hpp>
+#include <Types/HomogMatrix.hpp>
+
+#include "BoxFilter.hpp"
 
 namespace Processors {
 namespace PassThrough {
@@ -28,6 +32,9 @@ namespace PassThrough {
  */
 class PassThrough: public Base::Component {
 public:
+	/// Fixed-size Eigen member (pose) needs aligned allocation.
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
 	/*!
 	 * Constructor.
 	 */
@@ -72,11 +79,21 @@ protected:
         Base::DataStreamIn<pcl::PointCloud<pcl::PointXYZ>::Ptr> in_cloud_xyz;
         Base::DataStreamIn<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> in_cloud_xyzrgb;
         Base::DataStreamIn<pcl::PointCloud<PointXYZSIFT>::Ptr> in_cloud_xyzsift;
+        Base::DataStreamIn<pcl::PointCloud<PointXYZSHOT>::Ptr> in_cloud_xyzshot;
+        Base::DataStreamIn<pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr> in_cloud_xyzrgb_normal;
+
+        /// Pose of the crop volume in the sensor frame (oriented_box and prism modes).
+        Base::DataStreamIn<Types::HomogMatrix, Base::DataStreamBuffer::Newest> in_pose;
 
     // Output data streams
         Base::DataStreamOut<pcl::PointCloud<pcl::PointXYZ>::Ptr> out_cloud_xyz;
         Base::DataStreamOut<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> out_cloud_xyzrgb;
         Base::DataStreamOut<pcl::PointCloud<PointXYZSIFT>::Ptr> out_cloud_xyzsift;
+        Base::DataStreamOut<pcl::PointCloud<PointXYZSHOT>::Ptr> out_cloud_xyzshot;
+        Base::DataStreamOut<pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr> out_cloud_xyzrgb_normal;
+
+        /// Indices (in the input cloud) of points passing the filter.
+        Base::DataStreamOut<pcl::PointIndices::Ptr> out_indices;
 
         //Properties
         Base::Property<float> xa;
@@ -89,14 +106,48 @@ protected:
         Base::Property<bool> negative_y;
         Base::Property<bool> negative_z;
 
+        /*!
+         * Crop volume:
+         *  - box - axis-aligned box (limits in the sensor frame),
+         *  - oriented_box - the same limits, but in the frame given by in_pose,
+         *  - prism - polygon (in the XY plane of the in_pose frame) extruded between z.a and z.b.
+         */
+        Base::Property<std::string> mode;
+
+        /// Vertices of the prism base, e.g. "0 0; 0.5 0; 0.5 0.5".
+        Base::Property<std::string> polygon;
+
+        /// Output only indices, input clouds are passed on unchanged (no points are copied).
+        Base::Property<bool> indices_only;
+
+        /// Replace points outside the volume with NaNs (in a copy of the cloud), keeping it organized (no indices are written).
+        Base::Property<bool> keep_organized;
+
 
         // Handlers
         void filter_xyz();
         void filter_xyzrgb();
         void filter_xyzsift();
-
-        void applyFilter (pcl::PointCloud<PointXYZSIFT>::Ptr input, pcl::PointCloud<PointXYZSIFT> &output, std::string filter_field_name, float min, float max, bool negative);
-        void applyFilterIndices (std::vector<int> &indices, pcl::PointCloud<PointXYZSIFT>::Ptr input, std::string filter_field_name, float min, float max, bool negative);
+        void filter_xyzshot();
+        void filter_xyzrgb_normal();
+
+        /// Returns box defined by properties.
+        Box box() const;
+
+        /// Last pose of the crop volume (identity until the first one arrives).
+        Eigen::Matrix4f pose;
+
+        /// Tests all points of the cloud against the selected crop volume, reporting results to the sink.
+        template <typename PointT, typename Sink>
+        void scan(const pcl::PointCloud<PointT> & cloud, Sink & sink);
+
+        /*!
+         * Finds points of the cloud lying in the crop volume (single pass) and writes their indices.
+         * Unless indices_only is set, the points are also copied into a new cloud.
+         * With keep_organized a copy of the cloud, with points outside replaced by NaNs, is written instead.
+         */
+        template <typename PointT>
+        void crop(const typename pcl::PointCloud<PointT>::Ptr & cloud, Base::DataStreamOut<typename pcl::PointCloud<PointT>::Ptr> & out_cloud);
 
 };
 
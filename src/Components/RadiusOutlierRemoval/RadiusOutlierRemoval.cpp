@@ -0,0 +1,143 @@
+/*!
+ * \file
+ * \brief
+ * \author Maciej Stefańczyk [maciek.slon@gmail.com]
+ */
+
+#include <memory>
+#include <string>
+
+#include "RadiusOutlierRemoval.hpp"
+#include "Common/Logger.hpp"
+
+#include <boost/bind.hpp>
+
+#include <pcl/common/io.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace Processors {
+namespace RadiusOutlierRemoval {
+
+RadiusOutlierRemoval::RadiusOutlierRemoval(const std::string & name) :
+		Base::Component(name) ,
+		radius("radius", 0.01f),
+		min_neighbors("min_neighbors", 2),
+		negative("negative", false),
+		pass_through("pass_through", false),
+		threads("threads", 1) {
+	registerProperty(radius);
+	registerProperty(min_neighbors);
+	registerProperty(negative);
+	registerProperty(pass_through);
+	registerProperty(threads);
+}
+
+RadiusOutlierRemoval::~RadiusOutlierRemoval() {
+}
+
+void RadiusOutlierRemoval::prepareInterface() {
+	// Register data streams, events and event handlers HERE!
+	registerStream("in_cloud_xyzrgb", &in_cloud_xyzrgb);
+	registerStream("out_cloud_xyzrgb", &out_cloud_xyzrgb);
+	registerStream("in_cloud_xyz", &in_cloud_xyz);
+	registerStream("out_cloud_xyz", &out_cloud_xyz);
+
+	// Register handlers
+	registerHandler("filter_xyzrgb", boost::bind(&RadiusOutlierRemoval::filter_xyzrgb, this));
+	addDependency("filter_xyzrgb", &in_cloud_xyzrgb);
+
+	registerHandler("filter_xyz", boost::bind(&RadiusOutlierRemoval::filter_xyz, this));
+	addDependency("filter_xyz", &in_cloud_xyz);
+}
+
+bool RadiusOutlierRemoval::onInit() {
+
+	return true;
+}
+
+bool RadiusOutlierRemoval::onFinish() {
+	return true;
+}
+
+bool RadiusOutlierRemoval::onStop() {
+	return true;
+}
+
+bool RadiusOutlierRemoval::onStart() {
+	return true;
+}
+
+int RadiusOutlierRemoval::threadCount() const {
+#ifdef _OPENMP
+	// Non-positive values let OpenMP decide (usually one thread per core).
+	return threads > 0 ? (int) threads : omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+template <typename PointT>
+void RadiusOutlierRemoval::removeOutliers(typename pcl::PointCloud<PointT>::Ptr & cloud) {
+	if (radius <= 0) {
+		CLOG(LWARNING) << "RadiusOutlierRemoval: radius must be positive, passing cloud through";
+		return;
+	}
+
+	grid.build(*cloud, radius);
+
+	// Counting stops at min_neighbors, which is all the decision needs
+	const int n = cloud->points.size();
+	const int limit = min_neighbors;
+	counts.resize(n);
+
+	#pragma omp parallel for num_threads(threadCount()) schedule(dynamic, 256)
+	for (int i = 0; i < n; ++i) {
+		const PointT & p = cloud->points[i];
+		if (!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z))
+			counts[i] = -1;
+		else
+			counts[i] = grid.count(*cloud, i, limit);
+	}
+
+	std::vector<int> indices;
+	for (int i = 0; i < n; ++i)
+		if (counts[i] >= 0 && (counts[i] < limit) == negative)
+			indices.push_back(i);
+
+	// The input cloud is left intact, as it may be shared with other components
+	typename pcl::PointCloud<PointT>::Ptr filtered(new pcl::PointCloud<PointT>);
+	pcl::copyPointCloud(*cloud, indices, *filtered);
+	cloud = filtered;
+}
+
+void RadiusOutlierRemoval::filter_xyzrgb() {
+	CLOG(LTRACE) << "RadiusOutlierRemoval::filter_xyzrgb";
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = in_cloud_xyzrgb.read();
+
+	if (!pass_through) {
+		CLOG(LINFO) << "Before filtering Point cloud contained " << cloud->size() << " points";
+		removeOutliers<pcl::PointXYZRGB>(cloud);
+		CLOG(LINFO) << "After filtering Point cloud contained " << cloud->size() << " points";
+	}
+
+	out_cloud_xyzrgb.write(cloud);
+}
+
+void RadiusOutlierRemoval::filter_xyz() {
+	CLOG(LTRACE) << "RadiusOutlierRemoval::filter_xyz";
+	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = in_cloud_xyz.read();
+
+	if (!pass_through) {
+		CLOG(LINFO) << "Before filtering Point cloud contained " << cloud->size() << " points";
+		removeOutliers<pcl::PointXYZ>(cloud);
+		CLOG(LINFO) << "After filtering Point cloud contained " << cloud->size() << " points";
+	}
+
+	out_cloud_xyz.write(cloud);
+}
+
+} //: namespace RadiusOutlierRemoval
+} //: namespace Processors
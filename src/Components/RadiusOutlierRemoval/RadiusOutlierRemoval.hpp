@@ -0,0 +1,123 @@
+/*!
+ * \file
+ * \brief
+ * \author Maciej Stefańczyk [maciek.slon@gmail.com]
+ */
+
+#ifndef RADIUSOUTLIERREMOVAL_HPP_
+#define RADIUSOUTLIERREMOVAL_HPP_
+
+#include "Component_Aux.hpp"
+#include "Component.hpp"
+#include "DataStream.hpp"
+#include "Property.hpp"
+#include "EventHandler2.hpp"
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+#include <Types/RadiusGrid.hpp>
+
+namespace Processors {
+namespace RadiusOutlierRemoval {
+
+/*!
+ * \class RadiusOutlierRemoval
+ * \brief RadiusOutlierRemoval processor class.
+ *
+ * Removes points having less than min_neighbors other points within radius.
+ * Neighbours are counted in a uniform grid with cells of the radius size,
+ * in parallel.
+ */
+class RadiusOutlierRemoval: public Base::Component {
+public:
+	/*!
+	 * Constructor.
+	 */
+	RadiusOutlierRemoval(const std::string & name = "RadiusOutlierRemoval");
+
+	/*!
+	 * Destructor
+	 */
+	virtual ~RadiusOutlierRemoval();
+
+	/*!
+	 * Prepare components interface (register streams and handlers).
+	 * At this point, all properties are already initialized and loaded to
+	 * values set in config file.
+	 */
+	void prepareInterface();
+
+protected:
+
+	/*!
+	 * Connects source to given device.
+	 */
+	bool onInit();
+
+	/*!
+	 * Disconnect source from device, closes streams, etc.
+	 */
+	bool onFinish();
+
+	/*!
+	 * Start component
+	 */
+	bool onStart();
+
+	/*!
+	 * Stop component
+	 */
+	bool onStop();
+
+
+	// Input data streams
+
+	Base::DataStreamIn<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> in_cloud_xyzrgb;
+	Base::DataStreamIn<pcl::PointCloud<pcl::PointXYZ>::Ptr> in_cloud_xyz;
+
+	// Output data streams
+
+	Base::DataStreamOut<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> out_cloud_xyzrgb;
+	Base::DataStreamOut<pcl::PointCloud<pcl::PointXYZ>::Ptr> out_cloud_xyz;
+
+	/// Search radius (must be positive).
+	Base::Property<float> radius;
+
+	/// Minimal number of neighbours within radius for a point to be kept.
+	Base::Property<int> min_neighbors;
+
+	Base::Property<bool> negative;
+
+	Base::Property<bool> pass_through;
+
+	/// Number of threads counting neighbours (0 - one per core).
+	Base::Property<int> threads;
+
+	// Handlers
+	void filter_xyz();
+	void filter_xyzrgb();
+
+	/// Removes outliers, replacing the cloud with the filtered one (left as is for non-positive radius).
+	template <typename PointT>
+	void removeOutliers(typename pcl::PointCloud<PointT>::Ptr & cloud);
+
+	/// Returns number of worker threads to be used.
+	int threadCount() const;
+
+	/// Grid, buffers reused between frames.
+	Types::RadiusGrid grid;
+
+	/// Number of neighbours of every point (capped at min_neighbors), -1 for invalid points.
+	std::vector<int> counts;
+};
+
+} //: namespace RadiusOutlierRemoval
+} //: namespace Processors
+
+/*
+ * Register processor component.
+ */
+REGISTER_COMPONENT("RadiusOutlierRemoval", Processors::RadiusOutlierRemoval::RadiusOutlierRemoval)
+
+#endif /* RADIUSOUTLIERREMOVAL_HPP_ */
@@ -12,7 +12,12 @@
 
 #include <boost/bind.hpp>
 
-#include <pcl/filters/statistical_outlier_removal.h>
+#include <pcl/common/io.h>
+#include <pcl/search/kdtree.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace Processors {
 namespace StatisticalOutlierCounter {
@@ -21,10 +26,12 @@ StatisticalOutlierCounter::StatisticalOutlierCounter(const std::string & name) :
 		Base::Component(name) , 
 		negative("negative", false),
 		StddevMulThresh("StddevMulThresh", 1.0),
-		MeanK("MeanK", 50) {
+		MeanK("MeanK", 50),
+		threads("threads", 1) {
 		registerProperty(negative);
 		registerProperty(StddevMulThresh);
 		registerProperty(MeanK);
+		registerProperty(threads);
 
 }
 
@@ -37,6 +44,10 @@ void StatisticalOutlierCounter::prepareInterface() {
 	registerStream("out_cloud_xyzrgb", &out_cloud_xyzrgb);
 	registerStream("in_cloud_xyz", &in_cloud_xyz);
 	registerStream("out_cloud_xyz", &out_cloud_xyz);
+	registerStream("in_search_xyzrgb", &in_search_xyzrgb);
+	registerStream("in_search_xyz", &in_search_xyz);
+	registerStream("out_search_xyzrgb", &out_search_xyzrgb);
+	registerStream("out_search_xyz", &out_search_xyz);
 	// Register handlers
 	h_count_xyzrgb.setup(boost::bind(&StatisticalOutlierCounter::count_xyzrgb, this));
 	registerHandler("filter_xyzrgb", &h_count_xyzrgb);
@@ -65,32 +76,53 @@ bool StatisticalOutlierCounter::onStart() {
 	return true;
 }
 
+int StatisticalOutlierCounter::threadCount() const {
+#ifdef _OPENMP
+	// Non-positive values let OpenMP decide (usually one thread per core).
+	return threads > 0 ? (int) threads : omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+template <typename PointT>
+void StatisticalOutlierCounter::countOutliers(typename pcl::PointCloud<PointT>::Ptr & cloud,
+		Base::DataStreamIn<typename pcl::search::Search<PointT>::Ptr, Base::DataStreamBuffer::Newest> & in_search,
+		Base::DataStreamOut<typename pcl::search::Search<PointT>::Ptr> & out_search) {
+	// Reuse the upstream search structure only if it was built on this very cloud
+	typename pcl::search::Search<PointT>::Ptr search;
+	if (!in_search.empty())
+		search = in_search.read();
+	if (!search || search->getInputCloud() != cloud) {
+		search.reset(new pcl::search::KdTree<PointT>);
+		search->setInputCloud(cloud);
+		out_search.write(search);
+	}
+
+	Types::knnMeanDistances(*cloud, *search, MeanK, threadCount(), distances);
+	const Types::DistanceStatistics stats = Types::distanceStatistics(distances);
+
+	std::vector<int> indices;
+	Types::classifyDistances(distances, stats.threshold(StddevMulThresh), !negative, indices);
+	CLOG(LINFO) << "outliners: " << indices.size();
+
+	Types::classifyDistances(distances, stats.threshold(StddevMulThresh), negative, indices);
+	typename pcl::PointCloud<PointT>::Ptr filtered(new pcl::PointCloud<PointT>);
+	pcl::copyPointCloud(*cloud, indices, *filtered);
+	cloud = filtered;
+}
+
 void StatisticalOutlierCounter::count_xyzrgb() {
 		CLOG(LINFO) << "StatisticalOutlierCounter::filter_xyzrgb";
 	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = in_cloud_xyzrgb.read();
-	pcl::StatisticalOutlierRemoval<pcl::PointXYZRGB> sor;
-	sor.setInputCloud (cloud);
-	sor.setMeanK (MeanK);
-	sor.setStddevMulThresh (StddevMulThresh);
-	sor.setNegative (negative);
-	sor.filter (*cloud);
-	pcl::IndicesConstPtr indices = 	sor.getRemovedIndices ();
-	CLOG(LINFO) << "outliners: " << indices->size();
+	countOutliers<pcl::PointXYZRGB>(cloud, in_search_xyzrgb, out_search_xyzrgb);
 	out_cloud_xyzrgb.write(cloud);
 }
 
 void StatisticalOutlierCounter::count_xyz() {
 	CLOG(LINFO) << "StatisticalOutlierCounter::filter_xyzrgb";
 	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = in_cloud_xyz.read();
-	pcl::StatisticalOutlierRemoval<pcl::PointXYZ> sor;
-	sor.setInputCloud (cloud);
-	sor.setMeanK (MeanK);
-	sor.setStddevMulThresh (StddevMulThresh);
-	sor.setNegative (negative);
-	
-	sor.filter (*cloud);
-	pcl::IndicesConstPtr indices = 	sor.getRemovedIndices ();
-	CLOG(LINFO) << "outliners: " << indices->size();
+	countOutliers<pcl::PointXYZ>(cloud, in_search_xyz, out_search_xyz);
 	out_cloud_xyz.write(cloud);
 }
 
@@ -15,6 +15,9 @@
 
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
+#include <pcl/search/search.h>
+
+#include <Types/MeanDistances.hpp>
 
 namespace Processors {
 namespace StatisticalOutlierCounter {
@@ -24,6 +27,8 @@ namespace StatisticalOutlierCounter {
  * \brief StatisticalOutlierCounter processor class.
  *
  * StatisticalOutlierCounter processor.
+ * When the cloud is also filtered, out_stats of StatisticalOutlierRemoval
+ * provides the same counts without a second pass.
  */
 class StatisticalOutlierCounter: public Base::Component {
 public:
@@ -72,21 +77,44 @@ protected:
 	Base::DataStreamIn<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> in_cloud_xyzrgb;
 	Base::DataStreamIn<pcl::PointCloud<pcl::PointXYZ>::Ptr> in_cloud_xyz;
 
+	/// Search structures (kd-tree, octree) built upstream, used if built on the input cloud.
+	Base::DataStreamIn<pcl::search::Search<pcl::PointXYZRGB>::Ptr, Base::DataStreamBuffer::Newest> in_search_xyzrgb;
+	Base::DataStreamIn<pcl::search::Search<pcl::PointXYZ>::Ptr, Base::DataStreamBuffer::Newest> in_search_xyz;
+
 // Output data streams
 
 	Base::DataStreamOut<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> out_cloud_xyzrgb;
 	Base::DataStreamOut<pcl::PointCloud<pcl::PointXYZ>::Ptr> out_cloud_xyz;
+
+	/// Kd-trees built by this component, so that components processing the same cloud can reuse them.
+	Base::DataStreamOut<pcl::search::Search<pcl::PointXYZRGB>::Ptr> out_search_xyzrgb;
+	Base::DataStreamOut<pcl::search::Search<pcl::PointXYZ>::Ptr> out_search_xyz;
 	// Handlers
 	Base::EventHandler2 h_count_xyz;
 	Base::EventHandler2 h_count_xyzrgb;
 	Base::Property<bool> negative;
 	Base::Property<float> StddevMulThresh;
 	Base::Property<float> MeanK;
+
+	/// Number of threads computing mean distances (0 - one per core).
+	Base::Property<int> threads;
 	
 	// Handlers
 	void count_xyz();
 	void count_xyzrgb();
 
+	/// Counts outliers, replacing the cloud with the filtered one.
+	template <typename PointT>
+	void countOutliers(typename pcl::PointCloud<PointT>::Ptr & cloud,
+			Base::DataStreamIn<typename pcl::search::Search<PointT>::Ptr, Base::DataStreamBuffer::Newest> & in_search,
+			Base::DataStreamOut<typename pcl::search::Search<PointT>::Ptr> & out_search);
+
+	/// Returns number of worker threads to be used.
+	int threadCount() const;
+
+	/// Mean distances, buffer reused between frames.
+	std::vector<float> distances;
+
 };
 
 } //: namespace StatisticalOutlierCounter
@@ -4,6 +4,7 @@
  * \author Micha Laszkowski
  */
 
+#include <algorithm>
 #include <memory>
 #include <string>
 
@@ -12,7 +13,13 @@
 
 #include <boost/bind.hpp>
 
-#include <pcl/filters/statistical_outlier_removal.h>
+#include <pcl/common/io.h>
+#include <pcl/common/time.h>
+#include <pcl/search/kdtree.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace Processors {
 namespace StatisticalOutlierRemoval {
@@ -22,11 +29,19 @@ StatisticalOutlierRemoval::StatisticalOutlierRemoval(const std::string & name) :
 		negative("negative", false),
 		StddevMulThresh("StddevMulThresh", 1.0),
 		MeanK("MeanK", 50),
-		pass_through("pass_through", false) {
+		pass_through("pass_through", false),
+		method("method", std::string("kdtree")),
+		organized_window("organized.window", 7),
+		approximate_samples("approximate.samples", 1000),
+		threads("threads", 1) {
 	registerProperty(negative);
 	registerProperty(StddevMulThresh);
 	registerProperty(MeanK);
 	registerProperty(pass_through);
+	registerProperty(method);
+	registerProperty(organized_window);
+	registerProperty(approximate_samples);
+	registerProperty(threads);
 
 }
 
@@ -39,6 +54,11 @@ void StatisticalOutlierRemoval::prepareInterface() {
 	registerStream("out_cloud_xyzrgb", &out_cloud_xyzrgb);
 	registerStream("in_cloud_xyz", &in_cloud_xyz);
 	registerStream("out_cloud_xyz", &out_cloud_xyz);
+	registerStream("in_search_xyzrgb", &in_search_xyzrgb);
+	registerStream("in_search_xyz", &in_search_xyz);
+	registerStream("out_search_xyzrgb", &out_search_xyzrgb);
+	registerStream("out_search_xyz", &out_search_xyz);
+	registerStream("out_stats", &out_stats);
 
 	// Register handlers
 	registerHandler("filter_xyzrgb", boost::bind(&StatisticalOutlierRemoval::filter_xyzrgb, this));
@@ -66,6 +86,120 @@ bool StatisticalOutlierRemoval::onStart() {
 	return true;
 }
 
+int StatisticalOutlierRemoval::threadCount() const {
+#ifdef _OPENMP
+	// Non-positive values let OpenMP decide (usually one thread per core).
+	return threads > 0 ? (int) threads : omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+template <typename PointT>
+void StatisticalOutlierRemoval::removeOutliers(typename pcl::PointCloud<PointT>::Ptr & cloud,
+		Base::DataStreamIn<typename pcl::search::Search<PointT>::Ptr, Base::DataStreamBuffer::Newest> & in_search,
+		Base::DataStreamOut<typename pcl::search::Search<PointT>::Ptr> & out_search) {
+	pcl::StopWatch watch;
+
+	const std::string mode = method;
+	bool organized = mode == "organized";
+	if (organized && !cloud->isOrganized()) {
+		CLOG(LWARNING) << "StatisticalOutlierRemoval: cloud is not organized, using kd-tree";
+		organized = false;
+	}
+
+	Types::DistanceStatistics stats;
+	if (organized) {
+		// Window of the same size as used by organizedMeanDistances
+		const int side = 2 * std::max(1, organized_window / 2) + 1;
+		if (MeanK >= side * side - 1)
+			CLOG(LWARNING) << "StatisticalOutlierRemoval: " << side << "x" << side << " window holds only "
+					<< side * side - 1 << " neighbours, MeanK is " << MeanK;
+		Types::organizedMeanDistances(*cloud, organized_window, MeanK, threadCount(), distances);
+		stats = Types::distanceStatistics(distances);
+	} else {
+		// Reuse the upstream search structure only if it was built on this very cloud
+		typename pcl::search::Search<PointT>::Ptr search;
+		if (!in_search.empty())
+			search = in_search.read();
+		if (search && search->getInputCloud() != cloud)
+			search.reset();
+
+		if (mode == "approximate") {
+			// Statistics of the sample, then a cheap pass over all points. Without an upstream
+			// search the few sample queries are answered from a grid, no tree is built.
+			if (search) {
+				Types::sampledMeanDistances(*cloud, *search, MeanK, approximate_samples, threadCount(), distances,
+						sample_neighbours);
+			} else {
+				grid.build(*cloud, Types::RadiusGrid::nearestCell(*cloud, MeanK));
+				Types::RadiusGridSearch<PointT> grid_search(grid, *cloud);
+				Types::sampledMeanDistances(*cloud, grid_search, MeanK, approximate_samples, threadCount(), distances,
+						sample_neighbours);
+			}
+			stats = Types::distanceStatistics(distances);
+			const double threshold = stats.threshold(StddevMulThresh);
+			const int needed = Types::calibrateNeighbourCount(distances, sample_neighbours, MeanK, threshold);
+			CLOG(LDEBUG) << "StatisticalOutlierRemoval: keeping points with " << needed << " neighbours within " << threshold;
+			classifyApproximately(*cloud, threshold, needed);
+		} else {
+			if (!search) {
+				search.reset(new pcl::search::KdTree<PointT>);
+				search->setInputCloud(cloud);
+				out_search.write(search);
+			}
+			Types::knnMeanDistances(*cloud, *search, MeanK, threadCount(), distances);
+			stats = Types::distanceStatistics(distances);
+		}
+	}
+
+	const double threshold = stats.threshold(StddevMulThresh);
+	std::vector<int> indices;
+	Types::classifyDistances(distances, threshold, negative, indices);
+
+	// The input cloud is left intact, as it may be shared with other components
+	typename pcl::PointCloud<PointT>::Ptr filtered(new pcl::PointCloud<PointT>);
+	pcl::copyPointCloud(*cloud, indices, *filtered);
+	cloud = filtered;
+
+	// Statistics come from the same pass, no separate counter is needed
+	Types::OutlierStatistics outliers;
+	outliers.removed_indices.reset(new pcl::PointIndices);
+	outliers.removed_indices->header = cloud->header;
+	Types::classifyDistances(distances, threshold, !negative, outliers.removed_indices->indices);
+	outliers.removed = outliers.removed_indices->indices.size();
+	outliers.points = indices.size() + outliers.removed;
+	outliers.mean = stats.mean;
+	outliers.stddev = stats.stddev;
+	outliers.threshold = threshold;
+	outliers.time = watch.getTime();
+	CLOG(LDEBUG) << "StatisticalOutlierRemoval: removed " << outliers.removed << " of " << outliers.points
+			<< " points in " << outliers.time << " ms";
+	out_stats.write(outliers);
+}
+
+template <typename PointT>
+void StatisticalOutlierRemoval::classifyApproximately(const pcl::PointCloud<PointT> & cloud, double threshold, int needed) {
+	const int n = cloud.points.size();
+	distances.resize(n);
+
+	// Only distances of identical points could pass a non-positive threshold
+	const bool any = threshold > 0;
+	if (any)
+		grid.build(cloud, threshold);
+
+	#pragma omp parallel for num_threads(threadCount()) schedule(dynamic, 256)
+	for (int i = 0; i < n; ++i) {
+		const PointT & p = cloud.points[i];
+		if (!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z))
+			distances[i] = std::numeric_limits<float>::quiet_NaN();
+		else if (any && grid.count(cloud, i, needed) >= needed)
+			distances[i] = -std::numeric_limits<float>::infinity();
+		else
+			distances[i] = std::numeric_limits<float>::infinity();
+	}
+}
+
 void StatisticalOutlierRemoval::filter_xyzrgb() {
 	CLOG(LTRACE) << "StatisticalOutlierRemoval::filter_xyzrgb";
 	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = in_cloud_xyzrgb.read();
@@ -73,12 +207,7 @@ void StatisticalOutlierRemoval::filter_xyzrgb() {
 	if (!pass_through) {
 		CLOG(LINFO) << "Before filtering Point cloud contained " << cloud->size() << " points";
 
-		pcl::StatisticalOutlierRemoval<pcl::PointXYZRGB> sor;
-		sor.setInputCloud (cloud);
-		sor.setMeanK (MeanK);
-		sor.setStddevMulThresh (StddevMulThresh);
-		sor.setNegative (negative);
-		sor.filter (*cloud);
+		removeOutliers<pcl::PointXYZRGB>(cloud, in_search_xyzrgb, out_search_xyzrgb);
 
 		CLOG(LINFO) << "After filtering Point cloud contained " << cloud->size() << " points";
 	}
@@ -91,12 +220,7 @@ void StatisticalOutlierRemoval::filter_xyz() {
 	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = in_cloud_xyz.read();
 
 	if (!pass_through) {
-		pcl::StatisticalOutlierRemoval<pcl::PointXYZ> sor;
-		sor.setInputCloud (cloud);
-		sor.setMeanK (MeanK);
-		sor.setStddevMulThresh (StddevMulThresh);
-		sor.setNegative (negative);
-		sor.filter (*cloud);
+		removeOutliers<pcl::PointXYZ>(cloud, in_search_xyz, out_search_xyz);
 	}
 
 	out_cloud_xyz.write(cloud);
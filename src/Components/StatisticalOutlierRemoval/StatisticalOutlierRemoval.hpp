@@ -15,6 +15,11 @@
 
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
+#include <pcl/search/search.h>
+
+#include <Types/MeanDistances.hpp>
+#include <Types/OutlierStatistics.hpp>
+#include <Types/RadiusGrid.hpp>
 
 namespace Processors {
 namespace StatisticalOutlierRemoval {
@@ -72,21 +77,90 @@ protected:
 	Base::DataStreamIn<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> in_cloud_xyzrgb;
 	Base::DataStreamIn<pcl::PointCloud<pcl::PointXYZ>::Ptr> in_cloud_xyz;
 
+	/// Search structures (kd-tree, octree) built upstream, used if built on the input cloud.
+	Base::DataStreamIn<pcl::search::Search<pcl::PointXYZRGB>::Ptr, Base::DataStreamBuffer::Newest> in_search_xyzrgb;
+	Base::DataStreamIn<pcl::search::Search<pcl::PointXYZ>::Ptr, Base::DataStreamBuffer::Newest> in_search_xyz;
+
 	// Output data streams
 
 	Base::DataStreamOut<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> out_cloud_xyzrgb;
 	Base::DataStreamOut<pcl::PointCloud<pcl::PointXYZ>::Ptr> out_cloud_xyz;
 
+	/// Kd-trees built by this component (kdtree method), so that components processing the same cloud can reuse them.
+	Base::DataStreamOut<pcl::search::Search<pcl::PointXYZRGB>::Ptr> out_search_xyzrgb;
+	Base::DataStreamOut<pcl::search::Search<pcl::PointXYZ>::Ptr> out_search_xyz;
+
+	/// Statistics of every filtered cloud (removed points, distance statistics, timing).
+	Base::DataStreamOut<Types::OutlierStatistics> out_stats;
+
 	Base::Property<bool> negative;
 	Base::Property<float> StddevMulThresh;
 	Base::Property<float> MeanK;
 
 	Base::Property<bool> pass_through;
+
+	/*!
+	 * Neighbourhood used for mean distances: "kdtree" (MeanK nearest neighbours in space),
+	 * "organized" (MeanK nearest ones in a pixel window, organized clouds only)
+	 * or "approximate" (statistics from a sample, see classifyApproximately()).
+	 *
+	 * The organized window holds at most window^2 - 1 neighbours (48 for 7x7), so
+	 * with MeanK above that the mean covers fewer neighbours than with the kd-tree
+	 * (a warning is logged). Points without valid pixels in the window get distance
+	 * 0 and are kept, as isolated points are with the kd-tree.
+	 */
+	Base::Property<std::string> method;
+
+	/// Size of the pixel window of the organized method.
+	Base::Property<int> organized_window;
+
+	/*!
+	 * Number of points whose k-NN distances are computed by the approximate method
+	 * (with the upstream search if given, otherwise in a grid - no tree is built).
+	 */
+	Base::Property<int> approximate_samples;
+
+	/// Number of threads computing mean distances (0 - one per core).
+	Base::Property<int> threads;
 	
 	// Handlers
 	void filter_xyz();
 	void filter_xyzrgb();
 
+	/// Removes outliers with the selected method, replacing the cloud with the filtered one.
+	template <typename PointT>
+	void removeOutliers(typename pcl::PointCloud<PointT>::Ptr & cloud,
+			Base::DataStreamIn<typename pcl::search::Search<PointT>::Ptr, Base::DataStreamBuffer::Newest> & in_search,
+			Base::DataStreamOut<typename pcl::search::Search<PointT>::Ptr> & out_search);
+
+	/*!
+	 * Marks points as inliers (-infinity in distances) or outliers (infinity) without k-NN queries.
+	 *
+	 * A point is kept if at least needed neighbours lie within the threshold,
+	 * counted in a grid with threshold-sized cells and stopping as soon as
+	 * enough are found. needed is calibrated on the sample (see
+	 * Types::calibrateNeighbourCount), as the count within a radius only
+	 * approximates the mean distance: points with a few distant neighbours
+	 * among close ones, or with all neighbours just around the threshold, may
+	 * end up on the other side than with the exact method. The threshold itself
+	 * is estimated from approximate_samples points, so its error falls as
+	 * 1/sqrt(samples).
+	 */
+	template <typename PointT>
+	void classifyApproximately(const pcl::PointCloud<PointT> & cloud, double threshold, int needed);
+
+	/// Returns number of worker threads to be used.
+	int threadCount() const;
+
+	/// Mean distances, buffer reused between frames.
+	std::vector<float> distances;
+
+	/// Neighbour distances of samples of the approximate method.
+	std::vector<float> sample_neighbours;
+
+	/// Grid of the approximate method (sample queries, then neighbour counts), buffers reused between frames.
+	Types::RadiusGrid grid;
+
 };
 
 } //: namespace StatisticalOutlierRemoval
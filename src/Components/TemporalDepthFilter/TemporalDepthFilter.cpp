@@ -0,0 +1,235 @@
+/*!
+ * \file
+ * \brief
+ * \author Maciej Stefańczyk [maciek.slon@gmail.com]
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include "TemporalDepthFilter.hpp"
+#include "Common/Logger.hpp"
+
+#include <boost/bind.hpp>
+
+#include <stdint.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace Processors {
+namespace TemporalDepthFilter {
+
+namespace {
+
+const int max_history = 32;
+
+/// True if the new sample differs too much from the previous output.
+inline bool moved(uint16_t sample, uint16_t previous, int threshold) {
+	return threshold > 0 && sample != 0 && previous != 0 && std::abs((int) sample - (int) previous) > threshold;
+}
+
+/// Median of n samples (sorts them in place).
+inline uint16_t median(uint16_t * samples, int n) {
+	// Insertion sort - n is small
+	for (int i = 1; i < n; ++i) {
+		uint16_t s = samples[i];
+		int k = i;
+		for (; k > 0 && samples[k - 1] > s; --k)
+			samples[k] = samples[k - 1];
+		samples[k] = s;
+	}
+	return samples[n / 2];
+}
+
+} //: namespace
+
+TemporalDepthFilter::TemporalDepthFilter(const std::string & name) :
+		Base::Component(name),
+		prop_method("method", std::string("median")),
+		prop_history("history", 5),
+		prop_alpha("alpha", 0.3f),
+		prop_motion_threshold("motion_threshold", 50),
+		prop_threads("threads", 1),
+		history(0),
+		ema(false),
+		head(0),
+		count(0) {
+			registerProperty(prop_method);
+			registerProperty(prop_history);
+			registerProperty(prop_alpha);
+			registerProperty(prop_motion_threshold);
+			registerProperty(prop_threads);
+}
+
+TemporalDepthFilter::~TemporalDepthFilter() {
+}
+
+void TemporalDepthFilter::prepareInterface() {
+	// Register data streams, events and event handlers HERE!
+	registerStream("in_depth", &in_depth);
+	registerStream("out_depth", &out_depth);
+
+	// Register handlers
+	registerHandler("filter", boost::bind(&TemporalDepthFilter::filter, this));
+	addDependency("filter", &in_depth);
+}
+
+bool TemporalDepthFilter::onInit() {
+	return true;
+}
+
+bool TemporalDepthFilter::onFinish() {
+	return true;
+}
+
+bool TemporalDepthFilter::onStop() {
+	return true;
+}
+
+bool TemporalDepthFilter::onStart() {
+	return true;
+}
+
+int TemporalDepthFilter::threadCount() const {
+#ifdef _OPENMP
+	// Non-positive values let OpenMP decide (usually one thread per core).
+	return prop_threads > 0 ? (int) prop_threads : omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+void TemporalDepthFilter::reset(const cv::Mat & depth, int history_, bool ema_) {
+	if (history == history_ && ema == ema_ && !last.empty() && last.size() == depth.size())
+		return;
+
+	CLOG(LDEBUG) << "History reset: " << history_ << " frames of " << depth.cols << "x" << depth.rows;
+	history = history_;
+	ema = ema_;
+	head = 0;
+	count = 0;
+
+	if (ema) {
+		frames.clear();
+		average = cv::Mat::zeros(depth.rows, depth.cols, CV_32FC1);
+		missing = cv::Mat::zeros(depth.rows, depth.cols, CV_8UC1);
+	} else {
+		frames.resize(history);
+		for (int k = 0; k < history; ++k)
+			frames[k] = cv::Mat::zeros(depth.rows, depth.cols, CV_16UC1);
+		average.release();
+		missing.release();
+	}
+
+	last = cv::Mat::zeros(depth.rows, depth.cols, CV_16UC1);
+}
+
+void TemporalDepthFilter::filter() {
+	CLOG(LTRACE) << "TemporalDepthFilter::filter";
+
+	cv::Mat depth = in_depth.read();
+	if (depth.type() != CV_16UC1) {
+		CLOG(LERROR) << "TemporalDepthFilter: 16-bit depth image expected";
+		return;
+	}
+
+	reset(depth, std::min(std::max(1, (int) prop_history), max_history), std::string(prop_method) == "ema");
+
+	// New image every frame - the previous one may still be used downstream.
+	cv::Mat out(depth.rows, depth.cols, CV_16UC1);
+	if (ema)
+		filterEMA(depth, out);
+	else
+		filterMedian(depth, out);
+
+	out.copyTo(last);
+	out_depth.write(out);
+}
+
+void TemporalDepthFilter::filterMedian(const cv::Mat & depth, cv::Mat & out) {
+	// Store the new frame in place of the oldest one
+	head = (head + 1) % history;
+	count = std::min(count + 1, history);
+	depth.copyTo(frames[head]);
+
+	const int rows = depth.rows;
+	const int cols = depth.cols;
+	const int threshold = prop_motion_threshold;
+	const int n_frames = count;
+
+	#pragma omp parallel for num_threads(threadCount()) schedule(static)
+	for (int v = 0; v < rows; ++v) {
+		const uint16_t * frame_rows[max_history];
+		uint16_t * mutable_rows[max_history];
+		for (int k = 0; k < n_frames; ++k) {
+			mutable_rows[k] = frames[(head - k + history) % history].ptr<uint16_t>(v);
+			frame_rows[k] = mutable_rows[k];
+		}
+
+		const uint16_t * previous = last.ptr<uint16_t>(v);
+		uint16_t * out_row = out.ptr<uint16_t>(v);
+		uint16_t samples[max_history];
+
+		for (int u = 0; u < cols; ++u) {
+			const uint16_t sample = frame_rows[0][u];
+
+			// Motion - forget older samples of this pixel
+			if (moved(sample, previous[u], threshold)) {
+				for (int k = 1; k < n_frames; ++k)
+					mutable_rows[k][u] = 0;
+				out_row[u] = sample;
+				continue;
+			}
+
+			int n = 0;
+			for (int k = 0; k < n_frames; ++k)
+				if (frame_rows[k][u] != 0)
+					samples[n++] = frame_rows[k][u];
+
+			out_row[u] = n > 0 ? median(samples, n) : 0;
+		}
+	}
+}
+
+void TemporalDepthFilter::filterEMA(const cv::Mat & depth, cv::Mat & out) {
+	const int rows = depth.rows;
+	const int cols = depth.cols;
+	const int threshold = prop_motion_threshold;
+	const float alpha = std::min(std::max((float) prop_alpha, 0.0f), 1.0f);
+
+	#pragma omp parallel for num_threads(threadCount()) schedule(static)
+	for (int v = 0; v < rows; ++v) {
+		const uint16_t * depth_row = depth.ptr<uint16_t>(v);
+		const uint16_t * previous = last.ptr<uint16_t>(v);
+		float * average_row = average.ptr<float>(v);
+		uint8_t * missing_row = missing.ptr<uint8_t>(v);
+		uint16_t * out_row = out.ptr<uint16_t>(v);
+
+		for (int u = 0; u < cols; ++u) {
+			const uint16_t sample = depth_row[u];
+
+			if (sample == 0) {
+				// Keep the filtered value for at most history frames
+				if (missing_row[u] < history)
+					++missing_row[u];
+				if (missing_row[u] >= history)
+					average_row[u] = 0;
+			} else if (average_row[u] == 0 || moved(sample, previous[u], threshold)) {
+				average_row[u] = sample;
+				missing_row[u] = 0;
+			} else {
+				average_row[u] += alpha * (sample - average_row[u]);
+				missing_row[u] = 0;
+			}
+
+			out_row[u] = (uint16_t) (average_row[u] + 0.5f);
+		}
+	}
+}
+
+} //: namespace TemporalDepthFilter
+} //: namespace Processors
@@ -0,0 +1,142 @@
+/*!
+ * \file
+ * \brief
+ * \author Maciej Stefańczyk [maciek.slon@gmail.com]
+ */
+
+#ifndef TEMPORALDEPTHFILTER_HPP_
+#define TEMPORALDEPTHFILTER_HPP_
+
+#include <Component_Aux.hpp>
+#include <Component.hpp>
+#include <DataStream.hpp>
+#include <Property.hpp>
+#include <EventHandler2.hpp>
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+namespace Processors {
+namespace TemporalDepthFilter {
+
+/*!
+ * \class TemporalDepthFilter
+ * \brief Denoises raw depth images using the last few frames.
+ *
+ * Every pixel of the 16-bit (millimetre) depth image is filtered over time,
+ * either by the median of the last N samples or by an exponential moving
+ * average. Zero (missing) samples are ignored, so short dropouts are filled
+ * from the history. When the new sample differs from the filtered value by
+ * more than motion_threshold, the history of the pixel is dropped, so that
+ * moving objects do not leave trails.
+ *
+ * The output is meant to be fed to DepthConverter.in_depth - filtering the
+ * image is much cheaper than removing outliers from the resulting cloud.
+ */
+class TemporalDepthFilter: public Base::Component {
+public:
+	/*!
+	 * Constructor.
+	 */
+	TemporalDepthFilter(const std::string & name = "TemporalDepthFilter");
+
+	/*!
+	 * Destructor
+	 */
+	virtual ~TemporalDepthFilter();
+
+	/*!
+	 * Prepare components interface (register streams and handlers).
+	 * At this point, all properties are already initialized and loaded to 
+	 * values set in config file.
+	 */
+	void prepareInterface();
+
+protected:
+
+	/*!
+	 * Connects source to given device.
+	 */
+	bool onInit();
+
+	/*!
+	 * Disconnect source from device, closes streams, etc.
+	 */
+	bool onFinish();
+
+	/*!
+	 * Start component
+	 */
+	bool onStart();
+
+	/*!
+	 * Stop component
+	 */
+	bool onStop();
+
+	// Input data streams
+	Base::DataStreamIn<cv::Mat, Base::DataStreamBuffer::Newest> in_depth;
+
+	// Output data streams
+	Base::DataStreamOut<cv::Mat> out_depth;
+
+	// Handlers
+	void filter();
+
+	/// Filtering method: "median" or "ema".
+	Base::Property<std::string> prop_method;
+
+	/// Number of frames kept in the history (median window, at most 32).
+	Base::Property<int> prop_history;
+
+	/// Weight of the new sample in the exponential moving average.
+	Base::Property<float> prop_alpha;
+
+	/// Difference (in millimetres) resetting the history of the pixel (0 - never reset).
+	Base::Property<int> prop_motion_threshold;
+
+	/// Number of threads filtering rows in parallel (0 - one per core).
+	Base::Property<int> prop_threads;
+
+private:
+	/*!
+	 * Drops the history if the image size, history length or method has changed.
+	 * Only buffers of the selected method are allocated.
+	 */
+	void reset(const cv::Mat & depth, int history, bool ema);
+
+	void filterMedian(const cv::Mat & depth, cv::Mat & out);
+	void filterEMA(const cv::Mat & depth, cv::Mat & out);
+
+	/// Returns number of worker threads to be used.
+	int threadCount() const;
+
+	/// History length and method the buffers were allocated for.
+	int history;
+	bool ema;
+
+	/// Ring buffer of the last frames (CV_16UC1, median only), frames[head] is the newest one.
+	std::vector<cv::Mat> frames;
+	int head;
+	int count;
+
+	/// Filtered value of every pixel (CV_32FC1, EMA only).
+	cv::Mat average;
+
+	/// Number of consecutive missing samples of every pixel (CV_8UC1, EMA only).
+	cv::Mat missing;
+
+	/// Last output image (CV_16UC1).
+	cv::Mat last;
+};
+
+} //: namespace TemporalDepthFilter
+} //: namespace Processors
+
+/*
+ * Register processor component.
+ */
+REGISTER_COMPONENT("TemporalDepthFilter", Processors::TemporalDepthFilter::TemporalDepthFilter)
+
+#endif /* TEMPORALDEPTHFILTER_HPP_ */
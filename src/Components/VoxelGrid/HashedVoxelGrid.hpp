@@ -0,0 +1,153 @@
+/*!
+ * \file
+ * \brief Approximate voxel grid filter based on a fixed-size hash table.
+ */
+
+#ifndef HASHEDVOXELGRID_HPP_
+#define HASHEDVOXELGRID_HPP_
+
+#include <algorithm>
+#include <vector>
+
+#include <stdint.h>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+#include "VoxelKeys.hpp"
+#include "VoxelSum.hpp"
+
+namespace Processors {
+namespace VoxelGrid {
+
+/*!
+ * \class HashedVoxelGrid
+ * \brief Downsamples clouds in a single pass over points, without sorting.
+ *
+ * Voxels live in an open-addressing (linear probing) hash table with at
+ * least twice as many slots as the cloud has points (so at most a half of
+ * them is ever occupied), grown when needed and reused between frames -
+ * slots are stamped with the frame number instead of being cleared. If no
+ * free slot is found within a few probes, the voxel occupying the home slot
+ * is flushed to the output and its slot reused, so that voxel appears more
+ * than once in the output (as in pcl::ApproximateVoxelGrid), each time with
+ * the average of a part of its points. With the table sized to the cloud
+ * this is rare. Every voxel keeps either the running average of its points
+ * or just the first one.
+ */
+template <typename PointT>
+class HashedVoxelGrid {
+public:
+	HashedVoxelGrid() : bits(0), frame(0) {}
+
+	/*!
+	 * Downsamples the cloud, using at least capacity slots.
+	 * \returns false if some point lies too far from the origin for exact voxel keys (see VoxelKeys::fitsAbsolute)
+	 */
+	bool filter(const pcl::PointCloud<PointT> & cloud, const float leaf[3], int capacity, bool average, pcl::PointCloud<PointT> & output);
+
+private:
+	struct Slot {
+		Slot() : key(0), stamp(0) {}
+
+		uint64_t key;
+		uint32_t stamp;
+		VoxelSum<PointT> sum;
+	};
+
+	/// Maximal number of probed slots.
+	static const int max_probes = 8;
+
+	/// Grows the table to the capacity rounded up to a power of two.
+	void reserve(int capacity);
+
+	std::vector<Slot> slots;
+	int bits;
+	uint32_t frame;
+};
+
+template <typename PointT>
+void HashedVoxelGrid<PointT>::reserve(int capacity) {
+	int new_bits = 4;
+	while (new_bits < 30 && (1 << new_bits) < capacity)
+		++new_bits;
+	if (new_bits <= bits)
+		return;
+
+	bits = new_bits;
+	slots.assign(1 << bits, Slot());
+	frame = 0;
+}
+
+template <typename PointT>
+bool HashedVoxelGrid<PointT>::filter(const pcl::PointCloud<PointT> & cloud, const float leaf[3], int capacity, bool average, pcl::PointCloud<PointT> & output) {
+	// Every point may start a new voxel - keep the load factor at most 0.5
+	reserve(std::max(capacity, (int) (2 * cloud.points.size())));
+
+	// Stamps of the previous frames invalidate all slots at once
+	if (++frame == 0) {
+		slots.assign(slots.size(), Slot());
+		frame = 1;
+	}
+
+	output.header = cloud.header;
+	output.points.clear();
+	output.height = 1;
+	output.is_dense = true;
+
+	const float inv[3] = { 1.0f / leaf[0], 1.0f / leaf[1], 1.0f / leaf[2] };
+	const uint64_t mask = slots.size() - 1;
+
+	for (size_t i = 0; i < cloud.points.size(); ++i) {
+		const PointT & p = cloud.points[i];
+		if (!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z))
+			continue;
+
+		const float vx = p.x * inv[0], vy = p.y * inv[1], vz = p.z * inv[2];
+		if (!VoxelKeys::fitsAbsolute(vx, vy, vz))
+			return false;
+
+		const uint64_t key = VoxelKeys::absolute(vx, vy, vz);
+		const uint64_t home = (key * 0x9e3779b97f4a7c15ULL) >> (64 - bits);
+
+		Slot * slot = NULL;
+		for (int probe = 0; probe < max_probes; ++probe) {
+			Slot & candidate = slots[(home + probe) & mask];
+			if (candidate.stamp != frame || candidate.key == key) {
+				slot = &candidate;
+				break;
+			}
+		}
+
+		// Neighbourhood full - flush the voxel from the home slot
+		if (!slot) {
+			slot = &slots[home];
+			output.points.push_back(PointT());
+			slot->sum.get(output.points.back());
+			slot->stamp = 0;
+		}
+
+		if (slot->stamp != frame) {
+			slot->stamp = frame;
+			slot->key = key;
+			slot->sum = VoxelSum<PointT>();
+		}
+
+		if (average || slot->sum.n == 0)
+			slot->sum.add(p);
+	}
+
+	for (size_t s = 0; s < slots.size(); ++s) {
+		if (slots[s].stamp == frame) {
+			output.points.push_back(PointT());
+			slots[s].sum.get(output.points.back());
+		}
+	}
+	output.width = output.points.size();
+	return true;
+}
+
+} //: namespace VoxelGrid
+} //: namespace Processors
+
+#endif /* HASHEDVOXELGRID_HPP_ */
@@ -0,0 +1,188 @@
+/*!
+ * \file
+ * \brief Search for the leaf size giving the requested number of voxels.
+ */
+
+#ifndef LEAFSEARCH_HPP_
+#define LEAFSEARCH_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <stdint.h>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+#include "VoxelKeys.hpp"
+
+namespace Processors {
+namespace VoxelGrid {
+
+/*!
+ * \class LeafSearch
+ * \brief Scales the leaf size so that the cloud occupies the requested number of voxels.
+ *
+ * The number of occupied voxels for a given leaf is counted exactly, with a
+ * set of voxel keys (open addressing, reused between frames), stopping as
+ * soon as the count is known to be far too large. Voxels are computed the
+ * way the engines (and pcl::VoxelGrid) compute them, from the scaled leaf.
+ * Leaves so small that some point lies over VoxelKeys::absolute_range voxels
+ * from the origin count as giving far too many voxels. The scale is bracketed
+ * starting from the one found for the previous frame and then bisected (in
+ * the logarithmic domain), so for a steady stream only a few counts per
+ * frame are needed.
+ */
+class LeafSearch {
+public:
+	LeafSearch() : scale(1.0f), bits(0), stamp(0), last_count(0) {
+		base_leaf[0] = base_leaf[1] = base_leaf[2] = 1.0f;
+	}
+
+	/*!
+	 * Returns the factor by which the base leaf should be scaled.
+	 * \param tolerance relative tolerance of the number of voxels
+	 * \param iterations maximal number of counts
+	 */
+	template <typename PointT>
+	float search(const pcl::PointCloud<PointT> & cloud, const float leaf[3], int target,
+			float tolerance, int iterations);
+
+	/// Number of voxels obtained for the last returned scale.
+	int count() const { return last_count; }
+
+private:
+	/// Counts voxels of scaled size occupied by points, stopping after limit.
+	int countVoxels(float scale, int limit);
+
+	/// Coordinates of finite points.
+	std::vector<float> coords;
+
+	/// Leaf size the scale applies to.
+	float base_leaf[3];
+
+	/// Set of voxel keys - slot is occupied if its stamp equals the current one.
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> stamps;
+
+	float scale;
+	int bits;
+	uint32_t stamp;
+	int last_count;
+};
+
+template <typename PointT>
+float LeafSearch::search(const pcl::PointCloud<PointT> & cloud, const float leaf[3], int target,
+		float tolerance, int iterations) {
+	for (int a = 0; a < 3; ++a)
+		base_leaf[a] = leaf[a];
+
+	coords.clear();
+	for (size_t i = 0; i < cloud.points.size(); ++i) {
+		const PointT & p = cloud.points[i];
+		if (!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z))
+			continue;
+		coords.push_back(p.x);
+		coords.push_back(p.y);
+		coords.push_back(p.z);
+	}
+
+	const int points = coords.size() / 3;
+	// Nothing to reduce - the base leaf is used and the search starts over
+	if (target <= 0 || points <= target) {
+		scale = 1.0f;
+		last_count = points;
+		return 1.0f;
+	}
+
+	// Set with at most a half of slots occupied
+	int new_bits = 4;
+	while (new_bits < 30 && (1 << new_bits) < 2 * points)
+		++new_bits;
+	if (new_bits > bits) {
+		bits = new_bits;
+		keys.assign(1 << bits, 0);
+		stamps.assign(1 << bits, 0);
+		stamp = 0;
+	}
+
+	const int lo_target = (int) (target * (1 - tolerance));
+	const int hi_target = (int) (target * (1 + tolerance)) + 1;
+	const int limit = 4 * hi_target;
+
+	// Bracket the scale: count(lo) > target > count(hi)
+	float lo = 0, hi = 0;
+	float s = scale;
+	int count = countVoxels(s, limit);
+	int used = 1;
+	while (used < iterations && (count < lo_target || count > hi_target)) {
+		if (count > hi_target) {
+			lo = s;
+			if (hi > 0)
+				break;
+			s *= 1.5f;
+		} else {
+			hi = s;
+			if (lo > 0)
+				break;
+			s /= 1.5f;
+		}
+		count = countVoxels(s, limit);
+		++used;
+	}
+
+	// Bisection (geometric mean, voxel count falls roughly with the cube of the scale)
+	while (used < iterations && (count < lo_target || count > hi_target) && lo > 0 && hi > 0) {
+		s = std::sqrt(lo * hi);
+		count = countVoxels(s, limit);
+		++used;
+		if (count > hi_target)
+			lo = s;
+		else if (count < lo_target)
+			hi = s;
+	}
+
+	scale = s;
+	last_count = count;
+	return scale;
+}
+
+inline int LeafSearch::countVoxels(float s, int limit) {
+	if (++stamp == 0) {
+		std::fill(stamps.begin(), stamps.end(), 0);
+		stamp = 1;
+	}
+
+	// Same operations as leaf[a] *= scale followed by 1.0f / leaf[a] in the engines
+	const float inv[3] = { 1.0f / (base_leaf[0] * s), 1.0f / (base_leaf[1] * s), 1.0f / (base_leaf[2] * s) };
+	const uint64_t mask = keys.size() - 1;
+	const int points = coords.size() / 3;
+	int count = 0;
+
+	for (int i = 0; i < points && count <= limit; ++i) {
+		const float * c = &coords[3 * i];
+		const float vx = c[0] * inv[0], vy = c[1] * inv[1], vz = c[2] * inv[2];
+		if (!VoxelKeys::fitsAbsolute(vx, vy, vz))
+			return limit + 1;
+
+		const uint64_t key = VoxelKeys::absolute(vx, vy, vz);
+
+		uint64_t slot = (key * 0x9e3779b97f4a7c15ULL) >> (64 - bits);
+		while (stamps[slot] == stamp && keys[slot] != key)
+			slot = (slot + 1) & mask;
+
+		if (stamps[slot] != stamp) {
+			stamps[slot] = stamp;
+			keys[slot] = key;
+			++count;
+		}
+	}
+
+	return count;
+}
+
+} //: namespace VoxelGrid
+} //: namespace Processors
+
+#endif /* LEAFSEARCH_HPP_ */
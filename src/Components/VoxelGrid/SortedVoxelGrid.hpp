@@ -0,0 +1,154 @@
+/*!
+ * \file
+ * \brief Voxel grid filter based on sorting voxel keys.
+ */
+
+#ifndef SORTEDVOXELGRID_HPP_
+#define SORTEDVOXELGRID_HPP_
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+#include "VoxelKeys.hpp"
+#include "VoxelSum.hpp"
+
+namespace Processors {
+namespace VoxelGrid {
+
+/*!
+ * \class SortedVoxelGrid
+ * \brief Downsamples clouds by sorting points by their voxel keys.
+ *
+ * Points are given 64-bit voxel keys (see VoxelKeys), sorted with a parallel
+ * radix sort and every run of equal keys is reduced into a single point.
+ * Unlike pcl::VoxelGrid there is no 32-bit voxel index (which overflows for
+ * small leaves over large extents) and all stages run in parallel.
+ * Output points follow the order of voxel keys. Buffers are kept between frames.
+ */
+template <typename PointT>
+class SortedVoxelGrid {
+public:
+	/*!
+	 * Downsamples the cloud, replacing points of every voxel with their centroid.
+	 * \returns false if the extent of the cloud in voxels is too large for 64-bit keys
+	 */
+	bool filter(const pcl::PointCloud<PointT> & cloud, const float leaf[3], int threads, pcl::PointCloud<PointT> & output) {
+		return filter(cloud, leaf, threads, output, VoxelReduce<PointT>());
+	}
+
+	/*!
+	 * Downsamples the cloud, reducing points of every voxel with the given reducer
+	 * (called as reduce(cloud, indices, count, output_point)).
+	 */
+	template <typename Reduce>
+	bool filter(const pcl::PointCloud<PointT> & cloud, const float leaf[3], int threads, pcl::PointCloud<PointT> & output,
+			const Reduce & reduce);
+
+private:
+	/// Computes bounding box of finite points, returns false if there are none.
+	bool bounds(const pcl::PointCloud<PointT> & cloud, int threads, float min[3], float max[3]) const;
+
+	std::vector<uint64_t> keys;
+	std::vector<int> order;
+	std::vector<int> run_starts;
+	RadixSorter sorter;
+};
+
+template <typename PointT>
+bool SortedVoxelGrid<PointT>::bounds(const pcl::PointCloud<PointT> & cloud, int threads, float min[3], float max[3]) const {
+	const int n = cloud.points.size();
+	float lo[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+	float hi[3] = { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+
+	#pragma omp parallel num_threads(threads)
+	{
+		float t_lo[3] = { lo[0], lo[1], lo[2] };
+		float t_hi[3] = { hi[0], hi[1], hi[2] };
+
+		#pragma omp for schedule(static) nowait
+		for (int i = 0; i < n; ++i) {
+			const PointT & p = cloud.points[i];
+			if (!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z))
+				continue;
+			t_lo[0] = std::min(t_lo[0], p.x); t_hi[0] = std::max(t_hi[0], p.x);
+			t_lo[1] = std::min(t_lo[1], p.y); t_hi[1] = std::max(t_hi[1], p.y);
+			t_lo[2] = std::min(t_lo[2], p.z); t_hi[2] = std::max(t_hi[2], p.z);
+		}
+
+		#pragma omp critical
+		{
+			for (int a = 0; a < 3; ++a) {
+				lo[a] = std::min(lo[a], t_lo[a]);
+				hi[a] = std::max(hi[a], t_hi[a]);
+			}
+		}
+	}
+
+	for (int a = 0; a < 3; ++a) {
+		min[a] = lo[a];
+		max[a] = hi[a];
+	}
+	return lo[0] <= hi[0];
+}
+
+template <typename PointT>
+template <typename Reduce>
+bool SortedVoxelGrid<PointT>::filter(const pcl::PointCloud<PointT> & cloud, const float leaf[3], int threads, pcl::PointCloud<PointT> & output,
+		const Reduce & reduce) {
+	output.header = cloud.header;
+	output.points.clear();
+	output.width = 0;
+	output.height = 1;
+	output.is_dense = true;
+
+	float min[3], max[3];
+	if (!bounds(cloud, threads, min, max))
+		return true;
+
+	VoxelKeys voxel_keys;
+	if (!voxel_keys.setup(min, max, leaf))
+		return false;
+
+	// Keys of all points, non-finite ones get the invalid key (sorted last)
+	const int n = cloud.points.size();
+	const uint64_t invalid = voxel_keys.invalid();
+	keys.resize(n);
+	order.resize(n);
+
+	#pragma omp parallel for num_threads(threads) schedule(static)
+	for (int i = 0; i < n; ++i) {
+		const PointT & p = cloud.points[i];
+		const bool finite = pcl_isfinite(p.x) && pcl_isfinite(p.y) && pcl_isfinite(p.z);
+		keys[i] = finite ? voxel_keys.key(p.x, p.y, p.z) : invalid;
+		order[i] = i;
+	}
+
+	sorter.sort(keys, order, voxel_keys.bits() + 1, threads);
+
+	// Runs of equal keys
+	run_starts.clear();
+	int valid = 0;
+	for (; valid < n && keys[valid] != invalid; ++valid)
+		if (valid == 0 || keys[valid] != keys[valid - 1])
+			run_starts.push_back(valid);
+	run_starts.push_back(valid);
+
+	const int voxels = run_starts.size() - 1;
+	output.points.resize(voxels);
+	output.width = voxels;
+
+	#pragma omp parallel for num_threads(threads) schedule(static)
+	for (int v = 0; v < voxels; ++v)
+		reduce(cloud, &order[run_starts[v]], run_starts[v + 1] - run_starts[v], output.points[v]);
+
+	return true;
+}
+
+} //: namespace VoxelGrid
+} //: namespace Processors
+
+#endif /* SORTEDVOXELGRID_HPP_ */
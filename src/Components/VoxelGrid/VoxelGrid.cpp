@@ -4,6 +4,7 @@
  * \author Micha Laszkowski
  */
 
+#include <algorithm>
 #include <memory>
 #include <string>
 
@@ -14,6 +15,10 @@
 
 #include <pcl/filters/voxel_grid.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 namespace Processors {
 namespace VoxelGrid {
 
@@ -22,11 +27,33 @@ VoxelGrid::VoxelGrid(const std::string & name) :
 		x("LeafSize.x", 0.01f), 
 		y("LeafSize.y", 0.01f), 
 		z("LeafSize.z", 0.01f),
-		pass_through("pass_through", false){
+		pass_through("pass_through", false),
+		method("method", std::string("pcl")),
+		approximate_capacity("approximate.capacity", 65536),
+		approximate_average("approximate.average", true),
+		threads("threads", 1),
+		sift_representative("sift_representative", std::string("nearest")),
+		accumulate("accumulate", false),
+		accumulate_max_age("accumulate.max_age", 0),
+		accumulate_rate("accumulate.rate", 1),
+		accumulate_max_weight("accumulate.max_weight", 1000),
+		target_points("target_points", 0),
+		target_points_tolerance("target_points.tolerance", 0.05f){
 	registerProperty(x);
 	registerProperty(y);
 	registerProperty(z);
 	registerProperty(pass_through);
+	registerProperty(method);
+	registerProperty(approximate_capacity);
+	registerProperty(approximate_average);
+	registerProperty(threads);
+	registerProperty(sift_representative);
+	registerProperty(accumulate);
+	registerProperty(accumulate_max_age);
+	registerProperty(accumulate_rate);
+	registerProperty(accumulate_max_weight);
+	registerProperty(target_points);
+	registerProperty(target_points_tolerance);
 }
 
 VoxelGrid::~VoxelGrid() {
@@ -34,16 +61,31 @@ VoxelGrid::~VoxelGrid() {
 
 void VoxelGrid::prepareInterface() {
 	// Register data streams, events and event handlers HERE!
+	registerStream("in_cloud_xyz", &in_cloud_xyz);
 	registerStream("in_cloud_xyzrgb", &in_cloud_xyzrgb);
 	registerStream("in_cloud_xyzrgb_normal", &in_cloud_xyzrgb_normal);
+	registerStream("in_cloud_xyzsift", &in_cloud_xyzsift);
+	registerStream("in_trigger", &in_trigger);
+	registerStream("out_cloud_xyz", &out_cloud_xyz);
 	registerStream("out_cloud_xyzrgb", &out_cloud_xyzrgb);
 	registerStream("out_cloud_xyzrgb_normal", &out_cloud_xyzrgb_normal);
+	registerStream("out_cloud_xyzsift", &out_cloud_xyzsift);
 
 	// Register handlers
 	registerHandler("filter", boost::bind(&VoxelGrid::filter, this));
 	addDependency("filter", &in_cloud_xyzrgb);
  	registerHandler("filter_normal", boost::bind(&VoxelGrid::filter_normal, this));
  	addDependency("filter_normal", &in_cloud_xyzrgb_normal);
+	registerHandler("filter_xyz", boost::bind(&VoxelGrid::filter_xyz, this));
+	addDependency("filter_xyz", &in_cloud_xyz);
+	registerHandler("filter_xyzsift", boost::bind(&VoxelGrid::filter_xyzsift, this));
+	addDependency("filter_xyzsift", &in_cloud_xyzsift);
+
+	// Accumulated maps - on demand (no dependencies) or triggered.
+	registerHandler("emit_map", boost::bind(&VoxelGrid::emit_map, this));
+	registerHandler("reset_map", boost::bind(&VoxelGrid::reset_map, this));
+	registerHandler("onTriggeredEmitMap", boost::bind(&VoxelGrid::onTriggeredEmitMap, this));
+	addDependency("onTriggeredEmitMap", &in_trigger);
 }
 
 bool VoxelGrid::onInit() {
@@ -63,18 +105,117 @@ bool VoxelGrid::onStart() {
 	return true;
 }
 
+int VoxelGrid::threadCount() const {
+#ifdef _OPENMP
+	// Non-positive values let OpenMP decide (usually one thread per core).
+	return threads > 0 ? (int) threads : omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+template <typename PointT>
+void VoxelGrid::leafSize(const pcl::PointCloud<PointT> & cloud, LeafSearch & search, float leaf[3]) {
+	leaf[0] = x;
+	leaf[1] = y;
+	leaf[2] = z;
+	if (target_points <= 0)
+		return;
+
+	// Voxels are counted exactly as the engines compute them, so a handful of iterations suffices
+	const float scale = search.search(cloud, leaf, target_points, target_points_tolerance, 16);
+	for (int a = 0; a < 3; ++a)
+		leaf[a] *= scale;
+	CLOG(LDEBUG) << "VoxelGrid: leaf " << leaf[0] << " x " << leaf[1] << " x " << leaf[2] << " gives " << search.count()
+			<< " voxels (target " << target_points << ")";
+}
+
+template <typename PointT>
+void VoxelGrid::downsample(const typename pcl::PointCloud<PointT>::Ptr & cloud, pcl::PointCloud<PointT> & output,
+		SortedVoxelGrid<PointT> & sorted, HashedVoxelGrid<PointT> & hashed, LeafSearch & search) {
+	const std::string engine = method;
+
+	// All engines align voxels to the origin, as pcl::VoxelGrid does
+	float leaf[3];
+	leafSize(*cloud, search, leaf);
+
+	if (engine == "approximate") {
+		if (hashed.filter(*cloud, leaf, approximate_capacity, approximate_average, output))
+			return;
+		CLOG(LWARNING) << "VoxelGrid: cloud lies over " << VoxelKeys::absolute_range
+				<< " voxels from the origin, using pcl::VoxelGrid";
+	}
+
+	if (engine == "sort") {
+		if (sorted.filter(*cloud, leaf, threadCount(), output))
+			return;
+		CLOG(LWARNING) << "VoxelGrid: cloud extent too large for 64-bit voxel keys, using pcl::VoxelGrid";
+	}
+
+	pcl::VoxelGrid<PointT> vg;
+	vg.setInputCloud (cloud);
+	vg.setLeafSize (leaf[0], leaf[1], leaf[2]);
+	vg.filter (output);
+}
+
+template <typename PointT>
+void VoxelGrid::accumulateCloud(const typename pcl::PointCloud<PointT>::Ptr & cloud, VoxelMap<PointT> & map, Base::DataStreamOut<typename pcl::PointCloud<PointT>::Ptr> & out) {
+	const float leaf[3] = { x, y, z };
+	map.setLeaf(leaf);
+	const int skipped = map.add(*cloud, std::max(1, (int) accumulate_max_weight));
+	if (skipped > 0)
+		CLOG(LWARNING) << "VoxelGrid: " << skipped << " points lie over " << VoxelKeys::absolute_range
+				<< " voxels from the origin, left out of the map";
+	if (accumulate_max_age > 0)
+		map.evict(accumulate_max_age);
+	CLOG(LDEBUG) << "Voxel map contains " << map.size() << " voxels after " << map.frames() << " frames";
+
+	if (accumulate_rate > 0 && map.frames() % accumulate_rate == 0)
+		emitMap(map, out);
+}
+
+template <typename PointT>
+void VoxelGrid::emitMap(const VoxelMap<PointT> & map, Base::DataStreamOut<typename pcl::PointCloud<PointT>::Ptr> & out) {
+	typename pcl::PointCloud<PointT>::Ptr cloud(new pcl::PointCloud<PointT>);
+	map.get(*cloud);
+	CLOG(LINFO) << "Emitting voxel map of " << cloud->points.size() << " points";
+	out.write(cloud);
+}
+
+void VoxelGrid::emit_map() {
+	CLOG(LTRACE) << "VoxelGrid::emit_map";
+	if (map_xyz.frames() > 0)
+		emitMap(map_xyz, out_cloud_xyz);
+	if (map_xyzrgb.frames() > 0)
+		emitMap(map_xyzrgb, out_cloud_xyzrgb);
+	if (map_xyzrgb_normal.frames() > 0)
+		emitMap(map_xyzrgb_normal, out_cloud_xyzrgb_normal);
+}
+
+void VoxelGrid::reset_map() {
+	CLOG(LTRACE) << "VoxelGrid::reset_map";
+	map_xyz.clear();
+	map_xyzrgb.clear();
+	map_xyzrgb_normal.clear();
+}
+
+void VoxelGrid::onTriggeredEmitMap() {
+	CLOG(LTRACE) << "VoxelGrid::onTriggeredEmitMap";
+	in_trigger.read();
+	emit_map();
+}
+
 void VoxelGrid::filter() {
 	CLOG(LTRACE) << "VoxelGrid::filter" ;
 	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = in_cloud_xyzrgb.read();
 	
-	if (!pass_through) {
+	if (!pass_through && accumulate) {
+		accumulateCloud<pcl::PointXYZRGB>(cloud, map_xyzrgb, out_cloud_xyzrgb);
+	} else if (!pass_through) {
 		CLOG(LINFO) << "PointCloud before filtering contains " << cloud->points.size ()  << " points";
 
-		pcl::VoxelGrid<pcl::PointXYZRGB> vg;
 		pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_filtered (new pcl::PointCloud<pcl::PointXYZRGB>);
-		vg.setInputCloud (cloud);
-		vg.setLeafSize (x, y, z);
-		vg.filter (*cloud_filtered);
+		downsample<pcl::PointXYZRGB>(cloud, *cloud_filtered, sorted_xyzrgb, hashed_xyzrgb, search_xyzrgb);
 
 		CLOG(LINFO) << "PointCloud after filtering contains " << cloud_filtered->points.size ()  << " points";
 		out_cloud_xyzrgb.write(cloud_filtered);
@@ -89,14 +230,13 @@ void VoxelGrid::filter_normal () {
 	CLOG(LTRACE) << "VoxelGrid::filter_normal";
  	pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud = in_cloud_xyzrgb_normal.read();
 
-	if (!pass_through) {
+	if (!pass_through && accumulate) {
+		accumulateCloud<pcl::PointXYZRGBNormal>(cloud, map_xyzrgb_normal, out_cloud_xyzrgb_normal);
+	} else if (!pass_through) {
 		CLOG(LINFO) << "PointCloud before filtering contains " << cloud->points.size ()  << " points";
 
-		pcl::VoxelGrid<pcl::PointXYZRGBNormal> vg;
 		pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_filtered (new pcl::PointCloud<pcl::PointXYZRGBNormal>);
-		vg.setInputCloud (cloud);
-		vg.setLeafSize (x, y, z);
-		vg.filter (*cloud_filtered);
+		downsample<pcl::PointXYZRGBNormal>(cloud, *cloud_filtered, sorted_xyzrgb_normal, hashed_xyzrgb_normal, search_xyzrgb_normal);
 		CLOG(LINFO) << "PointCloud after filtering has: " << cloud_filtered->points.size ()  << " data points." << std::endl;
 	 	out_cloud_xyzrgb_normal.write(cloud_filtered);
 	} else {
@@ -105,5 +245,50 @@ void VoxelGrid::filter_normal () {
  
  }
 
+void VoxelGrid::filter_xyz() {
+	CLOG(LTRACE) << "VoxelGrid::filter_xyz";
+	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = in_cloud_xyz.read();
+
+	if (!pass_through && accumulate) {
+		accumulateCloud<pcl::PointXYZ>(cloud, map_xyz, out_cloud_xyz);
+	} else if (!pass_through) {
+		CLOG(LINFO) << "PointCloud before filtering contains " << cloud->points.size ()  << " points";
+
+		pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_filtered (new pcl::PointCloud<pcl::PointXYZ>);
+		downsample<pcl::PointXYZ>(cloud, *cloud_filtered, sorted_xyz, hashed_xyz, search_xyz);
+
+		CLOG(LINFO) << "PointCloud after filtering contains " << cloud_filtered->points.size ()  << " points";
+		out_cloud_xyz.write(cloud_filtered);
+	} else {
+		out_cloud_xyz.write(cloud);
+	}
+}
+
+void VoxelGrid::filter_xyzsift() {
+	CLOG(LTRACE) << "VoxelGrid::filter_xyzsift";
+	pcl::PointCloud<PointXYZSIFT>::Ptr cloud = in_cloud_xyzsift.read();
+
+	if (pass_through) {
+		out_cloud_xyzsift.write(cloud);
+		return;
+	}
+
+	CLOG(LINFO) << "PointCloud before filtering contains " << cloud->points.size ()  << " points";
+
+	// Keypoints are always picked by the sort engine - pcl::VoxelGrid would average descriptors.
+	float leaf[3];
+	leafSize(*cloud, search_xyzsift, leaf);
+	RepresentativeReduce<PointXYZSIFT> reduce(std::string(sift_representative) == "multiplicity");
+	pcl::PointCloud<PointXYZSIFT>::Ptr cloud_filtered (new pcl::PointCloud<PointXYZSIFT>);
+	if (!sorted_xyzsift.filter(*cloud, leaf, threadCount(), *cloud_filtered, reduce)) {
+		CLOG(LWARNING) << "VoxelGrid: cloud extent too large for 64-bit voxel keys, passing SIFT cloud through";
+		out_cloud_xyzsift.write(cloud);
+		return;
+	}
+
+	CLOG(LINFO) << "PointCloud after filtering contains " << cloud_filtered->points.size ()  << " points";
+	out_cloud_xyzsift.write(cloud_filtered);
+}
+
 } //: namespace VoxelGrid
 } //: namespace Processors
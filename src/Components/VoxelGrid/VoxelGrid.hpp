@@ -13,10 +13,14 @@
 #include "Property.hpp"
 #include "EventHandler2.hpp"
 
-//#include <Types/PointXYZSIFT.hpp>
+#include <Types/PointXYZSIFT.hpp>
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 
+#include "SortedVoxelGrid.hpp"
+#include "VoxelMap.hpp"
+#include "HashedVoxelGrid.hpp"
+#include "LeafSearch.hpp"
 
 namespace Processors {
 namespace VoxelGrid {
@@ -71,22 +75,127 @@ protected:
 
 
 	// Input data streams
+	Base::DataStreamIn<pcl::PointCloud<pcl::PointXYZ>::Ptr> in_cloud_xyz;
 	Base::DataStreamIn<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> in_cloud_xyzrgb;
 	Base::DataStreamIn<pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr> in_cloud_xyzrgb_normal;
+	Base::DataStreamIn<pcl::PointCloud<PointXYZSIFT>::Ptr> in_cloud_xyzsift;
+
+	/// Trigger emitting accumulated maps.
+	Base::DataStreamIn<Base::UnitType> in_trigger;
 
 	// Output data streams
+	Base::DataStreamOut<pcl::PointCloud<pcl::PointXYZ>::Ptr> out_cloud_xyz;
 	Base::DataStreamOut<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> out_cloud_xyzrgb;
 	Base::DataStreamOut<pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr> out_cloud_xyzrgb_normal;
+	Base::DataStreamOut<pcl::PointCloud<PointXYZSIFT>::Ptr> out_cloud_xyzsift;
 
 	// Handlers
 	Base::Property<float> x;
 	Base::Property<float> y;
 	Base::Property<float> z;
 	Base::Property<bool> pass_through;
+
+	/*!
+	 * Downsampling engine: "pcl" (pcl::VoxelGrid), "sort" (sorted 64-bit voxel keys, parallel)
+	 * or "approximate" (single pass through a fixed-size hash table, for previews).
+	 */
+	Base::Property<std::string> method;
+
+	/*!
+	 * Minimal number of slots of the hash table of the approximate engine. The table
+	 * grows to twice the number of input points, so voxels are rarely flushed early
+	 * (a flushed voxel appears in the output more than once).
+	 */
+	Base::Property<int> approximate_capacity;
+
+	/// Average points of voxels in the approximate engine (otherwise the first point is kept).
+	Base::Property<bool> approximate_average;
+
+	/// Number of threads used by the sort engine (0 - one per core).
+	Base::Property<int> threads;
+
+	/*!
+	 * Keypoint kept for every voxel of SIFT clouds: "nearest" (to the centroid)
+	 * or "multiplicity" (the highest one). Descriptors are never averaged.
+	 */
+	Base::Property<std::string> sift_representative;
+
+	/// Accumulate clouds in a voxel map kept between frames instead of downsampling each cloud.
+	Base::Property<bool> accumulate;
+
+	/// Evict voxels not observed for this many frames (0 - never).
+	Base::Property<int> accumulate_max_age;
+
+	/// Emit the map every n-th frame (0 - only on demand).
+	Base::Property<int> accumulate_rate;
+
+	/// Maximal number of points a voxel of the map is averaged over, older ones fade out.
+	Base::Property<int> accumulate_max_weight;
+
+	/*!
+	 * Scale the leaf (keeping proportions of LeafSize) so that the output has about this
+	 * many points (0 - use LeafSize as is). Not applied to accumulated maps.
+	 */
+	Base::Property<int> target_points;
+
+	/// Accepted relative deviation from target_points.
+	Base::Property<float> target_points_tolerance;
 	
 	// Handlers
 	void filter();
 	void filter_normal();
+	void filter_xyz();
+	void filter_xyzsift();
+
+	/// Emits accumulated maps.
+	void emit_map();
+
+	/// Clears accumulated maps.
+	void reset_map();
+
+	void onTriggeredEmitMap();
+
+	/// Downsamples the cloud with the selected engine.
+	template <typename PointT>
+	void downsample(const typename pcl::PointCloud<PointT>::Ptr & cloud, pcl::PointCloud<PointT> & output,
+			SortedVoxelGrid<PointT> & sorted, HashedVoxelGrid<PointT> & hashed, LeafSearch & search);
+
+	/// Merges the cloud into the map, emitting the map if it is time to.
+	template <typename PointT>
+	void accumulateCloud(const typename pcl::PointCloud<PointT>::Ptr & cloud, VoxelMap<PointT> & map, Base::DataStreamOut<typename pcl::PointCloud<PointT>::Ptr> & out);
+
+	/// Writes the current map to the output stream.
+	template <typename PointT>
+	void emitMap(const VoxelMap<PointT> & map, Base::DataStreamOut<typename pcl::PointCloud<PointT>::Ptr> & out);
+
+	/// Returns number of worker threads to be used.
+	int threadCount() const;
+
+	/// Computes the leaf to be used for the cloud, searching it if target_points is set.
+	template <typename PointT>
+	void leafSize(const pcl::PointCloud<PointT> & cloud, LeafSearch & search, float leaf[3]);
+
+	/// Sort engines, buffers reused between frames.
+	SortedVoxelGrid<pcl::PointXYZ> sorted_xyz;
+	SortedVoxelGrid<pcl::PointXYZRGB> sorted_xyzrgb;
+	SortedVoxelGrid<pcl::PointXYZRGBNormal> sorted_xyzrgb_normal;
+	SortedVoxelGrid<PointXYZSIFT> sorted_xyzsift;
+
+	/// Approximate engines, hash tables reused between frames.
+	HashedVoxelGrid<pcl::PointXYZ> hashed_xyz;
+	HashedVoxelGrid<pcl::PointXYZRGB> hashed_xyzrgb;
+	HashedVoxelGrid<pcl::PointXYZRGBNormal> hashed_xyzrgb_normal;
+
+	/// Accumulated maps.
+	VoxelMap<pcl::PointXYZ> map_xyz;
+	VoxelMap<pcl::PointXYZRGB> map_xyzrgb;
+	VoxelMap<pcl::PointXYZRGBNormal> map_xyzrgb_normal;
+
+	/// Leaf searches, seeded with the scale found for the previous cloud.
+	LeafSearch search_xyz;
+	LeafSearch search_xyzrgb;
+	LeafSearch search_xyzrgb_normal;
+	LeafSearch search_xyzsift;
 
 };
 
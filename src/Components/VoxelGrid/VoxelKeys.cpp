@@ -0,0 +1,123 @@
+/*!
+ * \file
+ * \brief 64-bit voxel keys and their parallel radix sort.
+ */
+
+#include "VoxelKeys.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace Processors {
+namespace VoxelGrid {
+
+namespace {
+
+/// Number of bits needed to store values 0..n-1.
+int bitsFor(double n) {
+	int bits = 0;
+	while (bits < 64 && std::ldexp(1.0, bits) < n)
+		++bits;
+	return bits;
+}
+
+} //: namespace
+
+const int32_t VoxelKeys::absolute_range;
+
+VoxelKeys::VoxelKeys() : key_bits(0), morton(true) {
+	for (int a = 0; a < 3; ++a) {
+		min_index[a] = 0;
+		inv_leaf[a] = 1;
+	}
+	shift[0] = shift[1] = 0;
+}
+
+bool VoxelKeys::setup(const float min[3], const float max[3], const float leaf[3]) {
+	int axis_bits[3];
+	for (int a = 0; a < 3; ++a) {
+		inv_leaf[a] = 1.0f / leaf[a];
+		// Voxel coordinates computed exactly as in key(), so the minimum gets zero
+		const double lo = std::floor(min[a] * inv_leaf[a]);
+		const double hi = std::floor(max[a] * inv_leaf[a]);
+		if (lo < -2147483648.0 || hi > 2147483647.0)
+			return false;
+		min_index[a] = (int32_t) lo;
+		axis_bits[a] = bitsFor(hi - lo + 1);
+	}
+
+	const int widest = std::max(axis_bits[0], std::max(axis_bits[1], axis_bits[2]));
+	morton = widest <= 21;
+	if (morton) {
+		key_bits = 3 * widest;
+	} else {
+		key_bits = axis_bits[0] + axis_bits[1] + axis_bits[2];
+		shift[0] = axis_bits[1] + axis_bits[2];
+		shift[1] = axis_bits[2];
+	}
+
+	// One more bit is needed for the invalid key
+	return key_bits < 64 && widest <= 32;
+}
+
+void RadixSorter::sort(std::vector<uint64_t> & keys, std::vector<int> & values, int bits, int threads) {
+	const int n = keys.size();
+	const int passes = (bits + 7) / 8;
+	threads = std::max(1, std::min(threads, n / 4096 + 1));
+
+	tmp_keys.resize(n);
+	tmp_values.resize(n);
+	histograms.resize(threads * 256);
+
+	for (int pass = 0; pass < passes; ++pass) {
+		const int shift = 8 * pass;
+
+		#pragma omp parallel num_threads(threads)
+		{
+#ifdef _OPENMP
+			const int t = omp_get_thread_num();
+			const int team = omp_get_num_threads();
+#else
+			const int t = 0;
+			const int team = 1;
+#endif
+			const int begin = (int) ((long long) n * t / team);
+			const int end = (int) ((long long) n * (t + 1) / team);
+			int * histogram = &histograms[t * 256];
+
+			std::fill(histogram, histogram + 256, 0);
+			for (int i = begin; i < end; ++i)
+				++histogram[(keys[i] >> shift) & 0xff];
+
+			#pragma omp barrier
+			#pragma omp single
+			{
+				// Output offsets - digit major, thread minor, which keeps the sort stable
+				int offset = 0;
+				for (int d = 0; d < 256; ++d) {
+					for (int k = 0; k < team; ++k) {
+						int count = histograms[k * 256 + d];
+						histograms[k * 256 + d] = offset;
+						offset += count;
+					}
+				}
+			}
+
+			for (int i = begin; i < end; ++i) {
+				int pos = histogram[(keys[i] >> shift) & 0xff]++;
+				tmp_keys[pos] = keys[i];
+				tmp_values[pos] = values[i];
+			}
+		}
+
+		keys.swap(tmp_keys);
+		values.swap(tmp_values);
+	}
+}
+
+} //: namespace VoxelGrid
+} //: namespace Processors
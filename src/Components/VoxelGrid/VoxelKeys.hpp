@@ -0,0 +1,123 @@
+/*!
+ * \file
+ * \brief 64-bit voxel keys and their parallel radix sort.
+ */
+
+#ifndef VOXELKEYS_HPP_
+#define VOXELKEYS_HPP_
+
+#include <cmath>
+#include <vector>
+
+#include <stdint.h>
+
+namespace Processors {
+namespace VoxelGrid {
+
+/*!
+ * \class VoxelKeys
+ * \brief Maps points onto 64-bit keys of their voxels.
+ *
+ * Voxels are aligned to the origin, as in pcl::VoxelGrid (and the other
+ * engines), but their coordinates are counted from the voxel containing the
+ * minimum of the cloud bounding box, so keys depend only on the extent of the
+ * cloud in voxels. As long as every axis fits in 21 bits (two million voxels),
+ * coordinates are interleaved into Morton keys, so that neighbouring voxels
+ * stay close in the sorted order. Larger extents use plain concatenation of
+ * coordinates, with as many bits per axis as needed.
+ */
+class VoxelKeys {
+public:
+	VoxelKeys();
+
+	/*!
+	 * Prepares keys for voxels of the given size covering the given box.
+	 * \returns false if voxel coordinates do not fit in 63 bits
+	 */
+	bool setup(const float min[3], const float max[3], const float leaf[3]);
+
+	/// Key of the voxel containing the (finite) point.
+	uint64_t key(float x, float y, float z) const {
+		const uint32_t ix = (uint32_t) ((int32_t) std::floor(x * inv_leaf[0]) - min_index[0]);
+		const uint32_t iy = (uint32_t) ((int32_t) std::floor(y * inv_leaf[1]) - min_index[1]);
+		const uint32_t iz = (uint32_t) ((int32_t) std::floor(z * inv_leaf[2]) - min_index[2]);
+		if (morton)
+			return spread(ix) | (spread(iy) << 1) | (spread(iz) << 2);
+		return ((uint64_t) ix << shift[0]) | ((uint64_t) iy << shift[1]) | (uint64_t) iz;
+	}
+
+	/// Number of significant key bits.
+	int bits() const { return key_bits; }
+
+	/// Key greater than all voxel keys, marking invalid points.
+	uint64_t invalid() const { return (uint64_t) 1 << key_bits; }
+
+	/// Absolute voxel coordinates must lie in [-absolute_range, absolute_range).
+	static const int32_t absolute_range = 1 << 20;
+
+	/*!
+	 * Checks if the voxel with given (fractional, absolute) coordinates has an exact
+	 * absolute() key. NaNs fail the check as well.
+	 */
+	static bool fitsAbsolute(float vx, float vy, float vz) {
+		const float range = (float) absolute_range;
+		return vx >= -range && vx < range && vy >= -range && vy < range && vz >= -range && vz < range;
+	}
+
+	/*!
+	 * Key of the voxel with given (fractional, absolute) coordinates, independent of
+	 * any cloud. Coordinates must pass fitsAbsolute() (21 bits, i.e. a million
+	 * voxels on both sides of the origin along every axis), otherwise distant
+	 * voxels would share keys.
+	 */
+	static uint64_t absolute(float vx, float vy, float vz) {
+		const int32_t bias = absolute_range;
+		return spread((uint32_t) ((int32_t) std::floor(vx) + bias)) |
+				(spread((uint32_t) ((int32_t) std::floor(vy) + bias)) << 1) |
+				(spread((uint32_t) ((int32_t) std::floor(vz) + bias)) << 2);
+	}
+
+	/// Spreads the lower 21 bits of v, so that there are two zero bits between every two of them.
+	static uint64_t spread(uint32_t v) {
+		uint64_t x = v & 0x1fffff;
+		x = (x | x << 32) & 0x1f00000000ffffULL;
+		x = (x | x << 16) & 0x1f0000ff0000ffULL;
+		x = (x | x << 8) & 0x100f00f00f00f00fULL;
+		x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+		x = (x | x << 2) & 0x1249249249249249ULL;
+		return x;
+	}
+
+private:
+	/// Absolute coordinates of the voxel containing the minimum.
+	int32_t min_index[3];
+	float inv_leaf[3];
+	int shift[2];
+	int key_bits;
+	bool morton;
+};
+
+/*!
+ * \class RadixSorter
+ * \brief Stable LSD radix sort of (key, value) pairs, parallel with OpenMP.
+ *
+ * Every pass sorts by eight key bits: threads build histograms of their
+ * part of the array, which are then turned into per-thread output offsets,
+ * so that the scatter can also run in parallel. Scratch buffers are kept
+ * between calls.
+ */
+class RadixSorter {
+public:
+	/// Sorts pairs by the lower bits of keys.
+	void sort(std::vector<uint64_t> & keys, std::vector<int> & values, int bits, int threads);
+
+private:
+	std::vector<uint64_t> tmp_keys;
+	std::vector<int> tmp_values;
+	std::vector<int> histograms;
+};
+
+} //: namespace VoxelGrid
+} //: namespace Processors
+
+#endif /* VOXELKEYS_HPP_ */
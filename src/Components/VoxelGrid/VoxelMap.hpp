@@ -0,0 +1,132 @@
+/*!
+ * \file
+ * \brief Voxel map accumulated over many clouds.
+ */
+
+#ifndef VOXELMAP_HPP_
+#define VOXELMAP_HPP_
+
+#include <cmath>
+
+#include <boost/unordered_map.hpp>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+#include "VoxelKeys.hpp"
+#include "VoxelSum.hpp"
+
+namespace Processors {
+namespace VoxelGrid {
+
+/*!
+ * \class VoxelMap
+ * \brief Running per-voxel sums, kept between frames.
+ *
+ * Every added cloud costs time proportional to its own size only - points
+ * are merged into the sums of their voxels, nothing is re-voxelized.
+ * Sums are kept in double precision and their weight is capped, so that
+ * a voxel observed for a long time holds a running mean of recent points
+ * instead of an ever growing sum.
+ * Voxels are addressed by absolute coordinates (see VoxelKeys::absolute).
+ * Voxels not observed for a given number of frames can be evicted.
+ */
+template <typename PointT>
+class VoxelMap {
+public:
+	VoxelMap() : frame(0) {
+		leaf[0] = leaf[1] = leaf[2] = 0;
+	}
+
+	/// Sets voxel size, clearing the map if it has changed.
+	void setLeaf(const float leaf_[3]) {
+		if (leaf_[0] != leaf[0] || leaf_[1] != leaf[1] || leaf_[2] != leaf[2]) {
+			clear();
+			for (int a = 0; a < 3; ++a)
+				leaf[a] = leaf_[a];
+		}
+	}
+
+	/*!
+	 * Merges finite points of the cloud into the map, each voxel weighing at most max_weight points.
+	 * Points too far from the origin to have exact voxel keys are skipped.
+	 * \returns number of skipped points
+	 */
+	int add(const pcl::PointCloud<PointT> & cloud, int max_weight) {
+		++frame;
+		const float inv[3] = { 1.0f / leaf[0], 1.0f / leaf[1], 1.0f / leaf[2] };
+		int skipped = 0;
+
+		for (size_t i = 0; i < cloud.points.size(); ++i) {
+			const PointT & p = cloud.points[i];
+			if (!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z))
+				continue;
+
+			const float vx = p.x * inv[0], vy = p.y * inv[1], vz = p.z * inv[2];
+			if (!VoxelKeys::fitsAbsolute(vx, vy, vz)) {
+				++skipped;
+				continue;
+			}
+
+			Entry & entry = voxels[VoxelKeys::absolute(vx, vy, vz)];
+			entry.sum.add(p);
+			entry.sum.limit(max_weight);
+			entry.last_seen = frame;
+		}
+
+		return skipped;
+	}
+
+	/// Removes voxels not observed during the last max_age frames.
+	void evict(int max_age) {
+		typename Map::iterator it = voxels.begin();
+		while (it != voxels.end()) {
+			if (frame - it->second.last_seen >= max_age)
+				it = voxels.erase(it);
+			else
+				++it;
+		}
+	}
+
+	/// Stores centroids of all voxels in the cloud.
+	void get(pcl::PointCloud<PointT> & output) const {
+		output.points.resize(voxels.size());
+		output.width = voxels.size();
+		output.height = 1;
+		output.is_dense = true;
+
+		size_t i = 0;
+		for (typename Map::const_iterator it = voxels.begin(); it != voxels.end(); ++it)
+			it->second.sum.get(output.points[i++]);
+	}
+
+	void clear() {
+		voxels.clear();
+		frame = 0;
+	}
+
+	/// Number of voxels in the map.
+	size_t size() const { return voxels.size(); }
+
+	/// Number of clouds added since the map was cleared.
+	int frames() const { return frame; }
+
+private:
+	struct Entry {
+		Entry() : last_seen(0) {}
+
+		VoxelSum<PointT, double> sum;
+		int last_seen;
+	};
+
+	typedef boost::unordered_map<uint64_t, Entry> Map;
+
+	Map voxels;
+	float leaf[3];
+	int frame;
+};
+
+} //: namespace VoxelGrid
+} //: namespace Processors
+
+#endif /* VOXELMAP_HPP_ */
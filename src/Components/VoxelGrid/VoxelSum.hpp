@@ -0,0 +1,219 @@
+/*!
+ * \file
+ * \brief Accumulation of points falling into the same voxel.
+ */
+
+#ifndef VOXELSUM_HPP_
+#define VOXELSUM_HPP_
+
+#include <cmath>
+#include <limits>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+namespace Processors {
+namespace VoxelGrid {
+
+/*!
+ * \class VoxelSum
+ * \brief Running sum of points of a single voxel.
+ *
+ * Provides add(point), merge(other sum) and get(point), which stores the
+ * centroid of the voxel. Specialized for every supported point type.
+ * Single frames use float sums, long-lived sums (VoxelMap) double ones,
+ * with limit(max_n) turning them into a running mean of bounded weight.
+ */
+template <typename PointT, typename Scalar = float>
+struct VoxelSum;
+
+/// Centroid.
+template <typename Scalar>
+struct VoxelSum<pcl::PointXYZ, Scalar> {
+	VoxelSum() : x(0), y(0), z(0), n(0) {}
+
+	void add(const pcl::PointXYZ & p) {
+		x += p.x; y += p.y; z += p.z;
+		++n;
+	}
+
+	void merge(const VoxelSum & s) {
+		x += s.x; y += s.y; z += s.z;
+		n += s.n;
+	}
+
+	void limit(int max_n) {
+		if (n <= max_n)
+			return;
+		const Scalar f = Scalar(max_n) / n;
+		x *= f; y *= f; z *= f;
+		n = max_n;
+	}
+
+	void get(pcl::PointXYZ & p) const {
+		const Scalar inv = Scalar(1) / n;
+		p.x = x * inv; p.y = y * inv; p.z = z * inv;
+	}
+
+	Scalar x, y, z;
+	int n;
+};
+
+/// Centroid and average colour.
+template <typename Scalar>
+struct VoxelSum<pcl::PointXYZRGB, Scalar> {
+	VoxelSum() : x(0), y(0), z(0), r(0), g(0), b(0), n(0) {}
+
+	void add(const pcl::PointXYZRGB & p) {
+		x += p.x; y += p.y; z += p.z;
+		r += p.r; g += p.g; b += p.b;
+		++n;
+	}
+
+	void merge(const VoxelSum & s) {
+		x += s.x; y += s.y; z += s.z;
+		r += s.r; g += s.g; b += s.b;
+		n += s.n;
+	}
+
+	void limit(int max_n) {
+		if (n <= max_n)
+			return;
+		const Scalar f = Scalar(max_n) / n;
+		x *= f; y *= f; z *= f;
+		r *= f; g *= f; b *= f;
+		n = max_n;
+	}
+
+	void get(pcl::PointXYZRGB & p) const {
+		const Scalar inv = Scalar(1) / n;
+		p.x = x * inv; p.y = y * inv; p.z = z * inv;
+		p.r = (uint8_t) (r * inv + Scalar(0.5));
+		p.g = (uint8_t) (g * inv + Scalar(0.5));
+		p.b = (uint8_t) (b * inv + Scalar(0.5));
+	}
+
+	Scalar x, y, z;
+	Scalar r, g, b;
+	int n;
+};
+
+/// Centroid, average colour, curvature and renormalized average normal.
+template <typename Scalar>
+struct VoxelSum<pcl::PointXYZRGBNormal, Scalar> {
+	VoxelSum() : x(0), y(0), z(0), r(0), g(0), b(0), nx(0), ny(0), nz(0), curvature(0), n(0) {}
+
+	void add(const pcl::PointXYZRGBNormal & p) {
+		x += p.x; y += p.y; z += p.z;
+		r += p.r; g += p.g; b += p.b;
+		nx += p.normal_x; ny += p.normal_y; nz += p.normal_z;
+		curvature += p.curvature;
+		++n;
+	}
+
+	void merge(const VoxelSum & s) {
+		x += s.x; y += s.y; z += s.z;
+		r += s.r; g += s.g; b += s.b;
+		nx += s.nx; ny += s.ny; nz += s.nz;
+		curvature += s.curvature;
+		n += s.n;
+	}
+
+	void limit(int max_n) {
+		if (n <= max_n)
+			return;
+		const Scalar f = Scalar(max_n) / n;
+		x *= f; y *= f; z *= f;
+		r *= f; g *= f; b *= f;
+		nx *= f; ny *= f; nz *= f;
+		curvature *= f;
+		n = max_n;
+	}
+
+	void get(pcl::PointXYZRGBNormal & p) const {
+		const Scalar inv = Scalar(1) / n;
+		p.x = x * inv; p.y = y * inv; p.z = z * inv;
+		p.r = (uint8_t) (r * inv + Scalar(0.5));
+		p.g = (uint8_t) (g * inv + Scalar(0.5));
+		p.b = (uint8_t) (b * inv + Scalar(0.5));
+		p.curvature = curvature * inv;
+
+		// Average of unit normals is shorter than one (or zero for opposite ones)
+		const Scalar length = std::sqrt(nx * nx + ny * ny + nz * nz);
+		const Scalar inv_length = length > 0 ? Scalar(1) / length : Scalar(0);
+		p.normal_x = nx * inv_length;
+		p.normal_y = ny * inv_length;
+		p.normal_z = nz * inv_length;
+	}
+
+	Scalar x, y, z;
+	Scalar r, g, b;
+	Scalar nx, ny, nz;
+	Scalar curvature;
+	int n;
+};
+
+/*!
+ * \class VoxelReduce
+ * \brief Turns all points of a voxel into its single output point (their centroid).
+ */
+template <typename PointT>
+struct VoxelReduce {
+	/// Reduces points with the given indices.
+	void operator()(const pcl::PointCloud<PointT> & cloud, const int * indices, int n, PointT & out) const {
+		VoxelSum<PointT> sum;
+		for (int i = 0; i < n; ++i)
+			sum.add(cloud.points[indices[i]]);
+		sum.get(out);
+	}
+};
+
+/*!
+ * \class RepresentativeReduce
+ * \brief Picks one of the points of a voxel, instead of averaging them.
+ *
+ * Meant for feature clouds, where averaging descriptors makes no sense.
+ * The picked point (with its descriptor) is copied unchanged. It is either
+ * the point nearest to the centroid of the voxel or the one with the highest
+ * multiplicity (the first one in case of ties).
+ */
+template <typename PointT>
+struct RepresentativeReduce {
+	explicit RepresentativeReduce(bool by_multiplicity_ = false) : by_multiplicity(by_multiplicity_) {}
+
+	void operator()(const pcl::PointCloud<PointT> & cloud, const int * indices, int n, PointT & out) const {
+		int best = indices[0];
+
+		if (by_multiplicity) {
+			for (int i = 1; i < n; ++i)
+				if (cloud.points[indices[i]].multiplicity > cloud.points[best].multiplicity)
+					best = indices[i];
+		} else {
+			float cx = 0, cy = 0, cz = 0;
+			for (int i = 0; i < n; ++i) {
+				const PointT & p = cloud.points[indices[i]];
+				cx += p.x; cy += p.y; cz += p.z;
+			}
+			cx /= n; cy /= n; cz /= n;
+
+			float best_distance = std::numeric_limits<float>::max();
+			for (int i = 0; i < n; ++i) {
+				const PointT & p = cloud.points[indices[i]];
+				const float distance = (p.x - cx) * (p.x - cx) + (p.y - cy) * (p.y - cy) + (p.z - cz) * (p.z - cz);
+				if (distance < best_distance) {
+					best_distance = distance;
+					best = indices[i];
+				}
+			}
+		}
+
+		out = cloud.points[best];
+	}
+
+	bool by_multiplicity;
+};
+
+} //: namespace VoxelGrid
+} //: namespace Processors
+
+#endif /* VOXELSUM_HPP_ */
@@ -0,0 +1,264 @@
+/*!
+ * \file
+ * \brief Mean neighbour distances and their statistics, shared by the statistical outlier filters.
+ */
+
+#ifndef MEANDISTANCES_HPP_
+#define MEANDISTANCES_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <stdint.h>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/search/search.h>
+
+namespace Types {
+
+/*!
+ * Mean distance of the (finite) point to its k nearest neighbours, computed
+ * exactly as pcl::StatisticalOutlierRemoval does: k points are searched,
+ * the first one (the query point itself, as the search object must be built
+ * on the same points) is skipped and the distances to the remaining ones are
+ * divided by k. Returns 0 if nothing is found. Any search object with the
+ * nearestKSearch() call of pcl::search::Search can be used (e.g.
+ * RadiusGridSearch). If neighbours is given, k ascending distances to the
+ * other points are stored there (infinity for missing ones).
+ */
+template <typename PointT, typename SearchT>
+float knnMeanDistance(const PointT & p, const SearchT & search, int k,
+		std::vector<int> & nn_indices, std::vector<float> & nn_dists, float * neighbours = NULL) {
+	const int found = search.nearestKSearch(p, k, nn_indices, nn_dists);
+	if (neighbours)
+		for (int j = 0; j < k; ++j)
+			neighbours[j] = j + 1 < found ? std::sqrt(nn_dists[j + 1]) : std::numeric_limits<float>::infinity();
+	if (found == 0)
+		return 0;
+
+	double sum = 0;
+	for (int j = 1; j < found; ++j)
+		sum += std::sqrt(nn_dists[j]);
+	return sum / k;
+}
+
+/*!
+ * Computes, for every point of the cloud, the mean distance to its k nearest
+ * neighbours (see knnMeanDistance). Invalid points get NaN.
+ * Queries are distributed among threads - the search object is only read.
+ */
+template <typename PointT>
+void knnMeanDistances(const pcl::PointCloud<PointT> & cloud, const pcl::search::Search<PointT> & search, int k, int threads,
+		std::vector<float> & distances) {
+	const int n = cloud.points.size();
+	distances.resize(n);
+
+	#pragma omp parallel num_threads(threads)
+	{
+		std::vector<int> nn_indices(k);
+		std::vector<float> nn_dists(k);
+
+		#pragma omp for schedule(dynamic, 256)
+		for (int i = 0; i < n; ++i) {
+			const PointT & p = cloud.points[i];
+			if (!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z))
+				distances[i] = std::numeric_limits<float>::quiet_NaN();
+			else
+				distances[i] = knnMeanDistance(p, search, k, nn_indices, nn_dists);
+		}
+	}
+}
+
+/*!
+ * Computes mean k-NN distances of the given number of finite points, drawn at
+ * random (with replacement), as a sample of the distribution of distances.
+ * The generator is seeded the same way for every cloud, so results are repeatable.
+ * Evenly spaced samples are avoided, as they alias with rows of organized clouds.
+ * Distances to the k neighbours of every sample are stored in neighbours.
+ */
+template <typename PointT, typename SearchT>
+void sampledMeanDistances(const pcl::PointCloud<PointT> & cloud, const SearchT & search, int k,
+		int samples, int threads, std::vector<float> & distances, std::vector<float> & neighbours) {
+	std::vector<int> valid;
+	for (size_t i = 0; i < cloud.points.size(); ++i) {
+		const PointT & p = cloud.points[i];
+		if (pcl_isfinite(p.x) && pcl_isfinite(p.y) && pcl_isfinite(p.z))
+			valid.push_back(i);
+	}
+
+	const int n = valid.empty() ? 0 : std::max(samples, 1);
+	distances.resize(n);
+	neighbours.resize(n * k);
+
+	// Xorshift generator, cheap and good enough for picking points
+	std::vector<int> picked(n);
+	uint32_t state = 2463534242u;
+	for (int s = 0; s < n; ++s) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		picked[s] = valid[state % valid.size()];
+	}
+
+	#pragma omp parallel num_threads(threads)
+	{
+		std::vector<int> nn_indices(k);
+		std::vector<float> nn_dists(k);
+
+		#pragma omp for schedule(dynamic, 16)
+		for (int s = 0; s < n; ++s) {
+			distances[s] = knnMeanDistance(cloud.points[picked[s]], search, k, nn_indices, nn_dists, &neighbours[s * k]);
+		}
+	}
+}
+
+/*!
+ * Finds the number of neighbours within the threshold that best separates the
+ * samples into inliers (mean distance not above the threshold) and outliers.
+ * Counting neighbours within a radius then stands in for the mean distance,
+ * and the count can stop early. neighbours holds k ascending distances per sample.
+ */
+inline int calibrateNeighbourCount(const std::vector<float> & distances, const std::vector<float> & neighbours, int k,
+		double threshold) {
+	// errors[c] - number of samples misclassified when at least c neighbours are required
+	std::vector<int> errors(k + 2, 0);
+	for (size_t s = 0; s < distances.size(); ++s) {
+		const float * d = &neighbours[s * k];
+		const int within = std::upper_bound(d, d + k, (float) threshold) - d;
+		const bool inlier = distances[s] <= threshold;
+		// Required count c classifies the sample as an inlier iff within >= c
+		for (int c = 1; c <= k; ++c)
+			if ((within >= c) != inlier)
+				++errors[c];
+	}
+
+	int best = (k + 1) / 2;
+	for (int c = 1; c <= k; ++c)
+		if (!distances.empty() && errors[c] < errors[best])
+			best = c;
+	return best;
+}
+
+/*!
+ * Computes, for every point of the organized cloud, the mean distance to its k
+ * nearest neighbours among valid pixels of the window x window neighbourhood,
+ * defined as in knnMeanDistance (the point itself is one of the k).
+ *
+ * On depth sensor data the nearest neighbours in space are almost always
+ * nearest in the image, so the rejection follows the kd-tree one closely,
+ * without building any tree. Invalid points get NaN, points without valid
+ * neighbours get 0 (as from pcl, which finds only the point itself). The
+ * window holds at most window^2 - 1 neighbours, so for larger k the mean is
+ * taken over fewer of them (still divided by k). Rows are processed in parallel.
+ */
+template <typename PointT>
+void organizedMeanDistances(const pcl::PointCloud<PointT> & cloud, int window, int k, int threads, std::vector<float> & distances) {
+	const int width = cloud.width;
+	const int height = cloud.height;
+	const int r = std::max(1, window / 2);
+	distances.resize(cloud.points.size());
+
+	#pragma omp parallel num_threads(threads)
+	{
+		std::vector<float> neighbours;
+		neighbours.reserve((2 * r + 1) * (2 * r + 1));
+
+		#pragma omp for schedule(static)
+		for (int v = 0; v < height; ++v) {
+			const int v0 = std::max(0, v - r), v1 = std::min(height - 1, v + r);
+
+			for (int u = 0; u < width; ++u) {
+				const PointT & p = cloud.points[v * width + u];
+				if (!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z)) {
+					distances[v * width + u] = std::numeric_limits<float>::quiet_NaN();
+					continue;
+				}
+
+				const int u0 = std::max(0, u - r), u1 = std::min(width - 1, u + r);
+				neighbours.clear();
+				for (int nv = v0; nv <= v1; ++nv) {
+					const PointT * row = &cloud.points[nv * width];
+					for (int nu = u0; nu <= u1; ++nu) {
+						const PointT & q = row[nu];
+						// NaN coordinates fail the comparison as well
+						const float dx = q.x - p.x, dy = q.y - p.y, dz = q.z - p.z;
+						const float d2 = dx * dx + dy * dy + dz * dz;
+						if (d2 == d2 && (nu != u || nv != v))
+							neighbours.push_back(d2);
+					}
+				}
+
+				if (neighbours.empty()) {
+					distances[v * width + u] = 0;
+					continue;
+				}
+
+				const int n = std::min<int>(k - 1, neighbours.size());
+				if (n < (int) neighbours.size())
+					std::nth_element(neighbours.begin(), neighbours.begin() + n, neighbours.end());
+
+				double sum = 0;
+				for (int i = 0; i < n; ++i)
+					sum += std::sqrt(neighbours[i]);
+				distances[v * width + u] = sum / std::max(k, 1);
+			}
+		}
+	}
+}
+
+/*!
+ * \struct DistanceStatistics
+ * \brief Mean and standard deviation of finite mean distances.
+ */
+struct DistanceStatistics {
+	DistanceStatistics() : mean(0), stddev(0), count(0) {}
+
+	double mean;
+	double stddev;
+	int count;
+
+	/// Distance above which points are outliers.
+	double threshold(double stddev_mult) const { return mean + stddev_mult * stddev; }
+};
+
+/// Computes statistics the same way pcl::StatisticalOutlierRemoval does.
+inline DistanceStatistics distanceStatistics(const std::vector<float> & distances) {
+	DistanceStatistics stats;
+	double sum = 0, sq_sum = 0;
+	for (size_t i = 0; i < distances.size(); ++i) {
+		const float d = distances[i];
+		if (!pcl_isfinite(d))
+			continue;
+		sum += d;
+		sq_sum += d * d;
+		++stats.count;
+	}
+
+	if (stats.count > 0)
+		stats.mean = sum / stats.count;
+	if (stats.count > 1)
+		stats.stddev = std::sqrt(std::max(0.0, (sq_sum - sum * sum / stats.count) / (stats.count - 1)));
+	return stats;
+}
+
+/*!
+ * Collects indices of inliers (or outliers, if negative is set) of valid points.
+ * Invalid (NaN) points belong to neither set.
+ */
+inline void classifyDistances(const std::vector<float> & distances, double threshold, bool negative, std::vector<int> & indices) {
+	indices.clear();
+	for (size_t i = 0; i < distances.size(); ++i) {
+		const float d = distances[i];
+		if (d != d)
+			continue;
+		if ((d > threshold) == negative)
+			indices.push_back(i);
+	}
+}
+
+} //: namespace Types
+
+#endif /* MEANDISTANCES_HPP_ */
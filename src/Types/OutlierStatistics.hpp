@@ -0,0 +1,42 @@
+/*!
+ * \file
+ * \brief Statistics of a single run of an outlier filter.
+ */
+
+#ifndef OUTLIERSTATISTICS_HPP_
+#define OUTLIERSTATISTICS_HPP_
+
+#include <pcl/PointIndices.h>
+
+namespace Types {
+
+/*!
+ * \struct OutlierStatistics
+ * \brief Outcome of filtering a single cloud, for monitoring.
+ */
+struct OutlierStatistics {
+	OutlierStatistics() : points(0), removed(0), mean(0), stddev(0), threshold(0), time(0) {}
+
+	/// Number of valid (finite) input points.
+	int points;
+
+	/// Number of valid points not passed to the output.
+	int removed;
+
+	/// Mean and standard deviation of mean neighbour distances.
+	double mean;
+	double stddev;
+
+	/// Distance threshold separating inliers from outliers.
+	double threshold;
+
+	/// Indices (in the input cloud) of removed points.
+	pcl::PointIndices::Ptr removed_indices;
+
+	/// Filtering time [ms].
+	double time;
+};
+
+} //: namespace Types
+
+#endif /* OUTLIERSTATISTICS_HPP_ */
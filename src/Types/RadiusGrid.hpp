@@ -0,0 +1,259 @@
+/*!
+ * \file
+ * \brief Uniform grid for neighbour counting and k-NN queries, shared by the outlier filters.
+ */
+
+#ifndef RADIUSGRID_HPP_
+#define RADIUSGRID_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/unordered_map.hpp>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+namespace Types {
+
+/*!
+ * \class RadiusGrid
+ * \brief Points bucketed into cubic cells with the edge equal to the search radius.
+ *
+ * All neighbours within the radius lie in the 27 cells around the cell of
+ * the query point, so counting them needs neither a tree nor sorting of
+ * distances. Points are sorted by their cells, so every cell is a contiguous
+ * range of indices. Buffers are kept between frames.
+ *
+ * The grid also answers k-NN queries, visiting cells in rings of growing
+ * size - cheaper than building a tree when only a few queries are needed.
+ */
+class RadiusGrid {
+public:
+	/// Buckets finite points of the cloud. The radius must be positive.
+	template <typename PointT>
+	void build(const pcl::PointCloud<PointT> & cloud, float radius);
+
+	/*!
+	 * Counts other points within the radius around the given point of the
+	 * cloud the grid was built on, stopping as soon as limit is reached.
+	 */
+	template <typename PointT>
+	int count(const pcl::PointCloud<PointT> & cloud, int index, int limit) const;
+
+	/*!
+	 * Finds the k points nearest to the (finite) point p, among points of the
+	 * cloud the grid was built on, with squared distances in ascending order.
+	 * Returns the number of points found (less than k only for small clouds).
+	 */
+	template <typename PointT>
+	int nearestKSearch(const pcl::PointCloud<PointT> & cloud, const PointT & p, int k, std::vector<int> & indices,
+			std::vector<float> & sqr_distances) const;
+
+	/*!
+	 * Cell size for k-NN queries - about k points per cell, assuming the points
+	 * cover a surface spanning the two largest extents of the bounding box, as
+	 * depth sensor clouds do. Other distributions only cost more visited cells.
+	 */
+	template <typename PointT>
+	static float nearestCell(const pcl::PointCloud<PointT> & cloud, int k);
+
+private:
+	/// Key of the cell with given coordinates (wrapped to 21 bits each).
+	static uint64_t key(int ix, int iy, int iz) {
+		const int bias = 1 << 20;
+		return ((uint64_t) ((ix + bias) & 0x1fffff) << 42) | ((uint64_t) ((iy + bias) & 0x1fffff) << 21) |
+				(uint64_t) ((iz + bias) & 0x1fffff);
+	}
+
+	typedef boost::unordered_map<uint64_t, std::pair<int, int> > Cells;
+
+	float cell;
+	float inv_cell;
+	float radius2;
+
+	/// (cell key, point index) pairs sorted by keys.
+	std::vector<std::pair<uint64_t, int> > entries;
+
+	/// Ranges of entries of every occupied cell.
+	Cells cells;
+};
+
+template <typename PointT>
+void RadiusGrid::build(const pcl::PointCloud<PointT> & cloud, float radius) {
+	cell = radius;
+	inv_cell = 1.0f / radius;
+	radius2 = radius * radius;
+
+	entries.clear();
+	for (size_t i = 0; i < cloud.points.size(); ++i) {
+		const PointT & p = cloud.points[i];
+		if (!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z))
+			continue;
+		const uint64_t k = key((int) std::floor(p.x * inv_cell), (int) std::floor(p.y * inv_cell),
+				(int) std::floor(p.z * inv_cell));
+		entries.push_back(std::make_pair(k, (int) i));
+	}
+	std::sort(entries.begin(), entries.end());
+
+	cells.clear();
+	for (size_t begin = 0; begin < entries.size();) {
+		size_t end = begin + 1;
+		while (end < entries.size() && entries[end].first == entries[begin].first)
+			++end;
+		cells[entries[begin].first] = std::make_pair((int) begin, (int) end);
+		begin = end;
+	}
+}
+
+template <typename PointT>
+int RadiusGrid::count(const pcl::PointCloud<PointT> & cloud, int index, int limit) const {
+	const PointT & p = cloud.points[index];
+	const int ix = (int) std::floor(p.x * inv_cell);
+	const int iy = (int) std::floor(p.y * inv_cell);
+	const int iz = (int) std::floor(p.z * inv_cell);
+
+	int found = 0;
+	for (int dx = -1; dx <= 1; ++dx) {
+		for (int dy = -1; dy <= 1; ++dy) {
+			for (int dz = -1; dz <= 1; ++dz) {
+				Cells::const_iterator cell = cells.find(key(ix + dx, iy + dy, iz + dz));
+				if (cell == cells.end())
+					continue;
+
+				for (int e = cell->second.first; e < cell->second.second; ++e) {
+					const int j = entries[e].second;
+					const PointT & q = cloud.points[j];
+					const float ex = q.x - p.x, ey = q.y - p.y, ez = q.z - p.z;
+					if (j != index && ex * ex + ey * ey + ez * ez <= radius2 && ++found >= limit)
+						return found;
+				}
+			}
+		}
+	}
+	return found;
+}
+
+template <typename PointT>
+int RadiusGrid::nearestKSearch(const pcl::PointCloud<PointT> & cloud, const PointT & p, int k, std::vector<int> & indices,
+		std::vector<float> & sqr_distances) const {
+	const int ix = (int) std::floor(p.x * inv_cell);
+	const int iy = (int) std::floor(p.y * inv_cell);
+	const int iz = (int) std::floor(p.z * inv_cell);
+	const int total = entries.size();
+	k = std::min(k, total);
+
+	std::vector<std::pair<float, int> > candidates;
+	for (int r = 0; ; ++r) {
+		// Once rings hold more cells than there are points, scanning all points is cheaper
+		const bool all = (double) (2 * r + 1) * (2 * r + 1) * (2 * r + 1) > total;
+		if (all) {
+			candidates.clear();
+			for (int e = 0; e < total; ++e) {
+				const PointT & q = cloud.points[entries[e].second];
+				const float ex = q.x - p.x, ey = q.y - p.y, ez = q.z - p.z;
+				candidates.push_back(std::make_pair(ex * ex + ey * ey + ez * ez, entries[e].second));
+			}
+		} else {
+			// Cells of the ring r (Chebyshev distance r from the cell of the query)
+			for (int dx = -r; dx <= r; ++dx) {
+				for (int dy = -r; dy <= r; ++dy) {
+					const bool side = dx == -r || dx == r || dy == -r || dy == r;
+					for (int dz = -r; dz <= r; dz += side ? 1 : 2 * std::max(r, 1)) {
+						Cells::const_iterator c = cells.find(key(ix + dx, iy + dy, iz + dz));
+						if (c == cells.end())
+							continue;
+
+						for (int e = c->second.first; e < c->second.second; ++e) {
+							const PointT & q = cloud.points[entries[e].second];
+							const float ex = q.x - p.x, ey = q.y - p.y, ez = q.z - p.z;
+							candidates.push_back(std::make_pair(ex * ex + ey * ey + ez * ez, entries[e].second));
+						}
+					}
+				}
+			}
+		}
+
+		if ((int) candidates.size() < k && !all)
+			continue;
+
+		// Points of further rings are more than r cells away from the query
+		std::nth_element(candidates.begin(), candidates.begin() + std::max(k - 1, 0), candidates.end());
+		const float reach = r * cell;
+		if (all || k == 0 || candidates[k - 1].first <= reach * reach)
+			break;
+	}
+
+	std::partial_sort(candidates.begin(), candidates.begin() + k, candidates.end());
+	indices.resize(k);
+	sqr_distances.resize(k);
+	for (int j = 0; j < k; ++j) {
+		sqr_distances[j] = candidates[j].first;
+		indices[j] = candidates[j].second;
+	}
+	return k;
+}
+
+template <typename PointT>
+float RadiusGrid::nearestCell(const pcl::PointCloud<PointT> & cloud, int k) {
+	int n = 0;
+	for (size_t i = 0; i < cloud.points.size(); ++i) {
+		const PointT & p = cloud.points[i];
+		if (pcl_isfinite(p.x) && pcl_isfinite(p.y) && pcl_isfinite(p.z))
+			++n;
+	}
+
+	// Extents between percentiles of a subset of points, so that a few far points do not matter
+	const size_t step = cloud.points.size() / 1024 + 1;
+	std::vector<float> coords[3];
+	for (size_t i = 0; i < cloud.points.size(); i += step) {
+		const PointT & p = cloud.points[i];
+		if (!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z))
+			continue;
+		coords[0].push_back(p.x);
+		coords[1].push_back(p.y);
+		coords[2].push_back(p.z);
+	}
+	if (coords[0].empty())
+		return 1.0f;
+
+	float extent[3];
+	const size_t lo = coords[0].size() / 50, hi = coords[0].size() - 1 - lo;
+	for (int a = 0; a < 3; ++a) {
+		std::nth_element(coords[a].begin(), coords[a].begin() + lo, coords[a].end());
+		const float min = coords[a][lo];
+		std::nth_element(coords[a].begin(), coords[a].begin() + hi, coords[a].end());
+		extent[a] = (coords[a][hi] - min) * coords[a].size() / (hi - lo + 1);
+	}
+
+	std::sort(extent, extent + 3);
+	const double area = (double) extent[2] * std::max(extent[1], extent[2] * 1e-3f);
+	const float size = std::sqrt(area * std::max(k, 1) / std::max(n, 1));
+	return size > 0 ? size : 1.0f;
+}
+
+/*!
+ * \class RadiusGridSearch
+ * \brief k-NN queries on a RadiusGrid, with the same call as pcl::search::Search.
+ */
+template <typename PointT>
+class RadiusGridSearch {
+public:
+	RadiusGridSearch(const RadiusGrid & grid_, const pcl::PointCloud<PointT> & cloud_) : grid(grid_), cloud(cloud_) {}
+
+	int nearestKSearch(const PointT & p, int k, std::vector<int> & indices, std::vector<float> & sqr_distances) const {
+		return grid.nearestKSearch(cloud, p, k, indices, sqr_distances);
+	}
+
+private:
+	const RadiusGrid & grid;
+	const pcl::PointCloud<PointT> & cloud;
+};
+
+} //: namespace Types
+
+#endif /* RADIUSGRID_HPP_ */